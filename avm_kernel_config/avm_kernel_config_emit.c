@@ -0,0 +1,268 @@
+// vim: set tabstop=4 syntax=c :
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/***********************************************************************
+ *                                                                     *
+ *                                                                     *
+ * Copyright (C) 2016-2021 P.Hämmerlein (http://www.yourfritz.de)      *
+ *                                                                     *
+ * This program is free software; you can redistribute it and/or       *
+ * modify it under the terms of the GNU General Public License         *
+ * as published by the Free Software Foundation; either version 2      *
+ * of the License, or (at your option) any later version.              *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program, please look for the file COPYING.          *
+ *                                                                     *
+ ***********************************************************************/
+
+#include "avm_kernel_config_helpers.h"
+#include <stdarg.h>
+
+//	output layer
+//
+//	- all output is collected in a large buffer and written with a few 'write' calls
+//	- DTB content is formatted from a lookup table with the hexadecimal presentation of each byte value
+
+#define OUTPUT_BUFFER_SIZE		(1024 * 1024)
+#define BYTES_PER_LINE			16
+#define BYTE_DIRECTIVE			"\t.byte\t"
+#define BYTE_DIRECTIVE_SIZE		(sizeof(BYTE_DIRECTIVE) - 1)
+
+#define HEX_DIGIT(n)			((n) < 10 ? '0' + (n) : 'a' + (n) - 10)
+#define HEX_1(n)				{ '0', 'x', HEX_DIGIT((n) >> 4), HEX_DIGIT((n) & 0x0F) }
+#define HEX_4(n)				HEX_1(n), HEX_1((n) + 1), HEX_1((n) + 2), HEX_1((n) + 3)
+#define HEX_16(n)				HEX_4(n), HEX_4((n) + 4), HEX_4((n) + 8), HEX_4((n) + 12)
+#define HEX_64(n)				HEX_16(n), HEX_16((n) + 16), HEX_16((n) + 32), HEX_16((n) + 48)
+
+struct outputBuffer
+{
+	int					fd;
+	char *				buffer;
+	size_t				used;
+	bool				failed;
+};
+
+static const char			hexTable[256][4] = { HEX_64(0), HEX_64(64), HEX_64(128), HEX_64(192) };
+
+static bool outputFlush(struct outputBuffer *output)
+{
+	size_t				done = 0;
+	ssize_t				written;
+
+	while (!output->failed && done < output->used)
+	{
+		if ((written = write(output->fd, output->buffer + done, output->used - done)) == -1)
+		{
+			if (errno == EINTR) continue;
+			fprintf(stderr, "Error %d writing output.\n", errno);
+			output->failed = true;
+		}
+		else done += written;
+	}
+	output->used = 0;
+
+	return !output->failed;
+}
+
+static void outputReserve(struct outputBuffer *output, size_t size)
+{
+
+	if (output->used + size > OUTPUT_BUFFER_SIZE) outputFlush(output);
+
+}
+
+static void outputPrintf(struct outputBuffer *output, const char *format, ...)
+{
+	va_list				args;
+	int					size;
+
+	outputReserve(output, 1024);
+
+	va_start(args, format);
+	size = vsnprintf(output->buffer + output->used, OUTPUT_BUFFER_SIZE - output->used, format, args);
+	va_end(args);
+
+	if (size < 0) return;
+	if ((size_t) size >= OUTPUT_BUFFER_SIZE - output->used)
+	{
+		// very long line, format it again after the buffer was flushed
+		outputFlush(output);
+		va_start(args, format);
+		size = vsnprintf(output->buffer, OUTPUT_BUFFER_SIZE, format, args);
+		va_end(args);
+		if (size < 0) return;
+		if ((size_t) size >= OUTPUT_BUFFER_SIZE) size = OUTPUT_BUFFER_SIZE - 1;
+	}
+	output->used += size;
+}
+
+static void outputBytes(struct outputBuffer *output, const uint8_t *source, size_t size)
+{
+
+	while (size > 0)
+	{
+		size_t			count = (size > BYTES_PER_LINE ? BYTES_PER_LINE : size);
+		char *			line;
+
+		outputReserve(output, BYTE_DIRECTIVE_SIZE + count * 5);
+		line = output->buffer + output->used;
+
+		memcpy(line, BYTE_DIRECTIVE, BYTE_DIRECTIVE_SIZE);
+		line += BYTE_DIRECTIVE_SIZE;
+		for (size_t i = 0; i < count; i++)
+		{
+			memcpy(line, hexTable[*(source++)], 4);
+			line += 4;
+			*(line++) = (i + 1 < count ? ',' : '\n');
+		}
+
+		output->used = line - output->buffer;
+		size -= count;
+	}
+
+}
+
+static bool writeDeviceTreeFile(struct outputBuffer *output, const char *fileName, const uint8_t *source, size_t size)
+{
+	int					fd;
+	bool				result = false;
+
+	if ((fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644)) != -1)
+	{
+		if (write(fd, source, size) == (ssize_t) size) result = true;
+		else fprintf(stderr, "Error %d writing device tree file '%s'.\n", errno, fileName);
+		close(fd);
+	}
+	else fprintf(stderr, "Error %d creating device tree file '%s'.\n", errno, fileName);
+
+	if (!result) output->failed = true;
+
+	return result;
+}
+
+static void processDeviceTrees(struct outputBuffer *output, const struct configAreaView *view, const char *incbinPrefix)
+{
+
+	outputPrintf(output, "\n"); // empty line as optical delimiter in front of DTB dump
+
+	for (unsigned int subRev = 0; subRev <= avm_kernel_config_tags_device_tree_subrev_last - avm_kernel_config_tags_device_tree_subrev_0; subRev++)
+	{
+		const uint8_t *	dtb = getConfigAreaEntry(view->area, &view->index, avm_kernel_config_tags_device_tree_subrev_0 + subRev);
+		uint32_t		dtbSize;
+
+		if (dtb == NULL) continue;
+
+		memcpy(&dtbSize, dtb + sizeof(uint32_t), sizeof(uint32_t));
+
+		outputPrintf(output, ".L_avm_device_tree_subrev_%u:\n", subRev);
+		outputPrintf(output, "\tAVM_DEVICE_TREE_BLOB\t%u\n", subRev);
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		// the 'dtc' compiler always emits this value in 'big endian' (using ASM_EMIT_BELONG
+		// in 'flattree.c' - see there)
+		swapEndianess(true, &dtbSize);
+#endif
+
+		// the FDT has to be contained in the area
+		if (dtbSize > view->size - (dtb - view->area)) dtbSize = view->size - (dtb - view->area);
+
+		if (incbinPrefix != NULL)
+		{
+			char *		fileName = malloc(strlen(incbinPrefix) + 20);
+
+			if (fileName == NULL)
+			{
+				fprintf(stderr, "Error %d allocating memory for a file name.\n", errno);
+				output->failed = true;
+				return;
+			}
+			sprintf(fileName, "%s.subrev%u.dtb", incbinPrefix, subRev);
+			if (writeDeviceTreeFile(output, fileName, dtb, dtbSize))
+				outputPrintf(output, "\t.incbin\t\"%s\"\n", fileName);
+			free(fileName);
+		}
+		else outputBytes(output, dtb, dtbSize);
+	}
+}
+
+static void processVersionInfo(struct outputBuffer *output, const struct configAreaView *view)
+{
+	const struct _avm_kernel_version_info *	version = getConfigAreaEntry(view->area, &view->index, avm_kernel_config_tags_version_info);
+
+	if (version == NULL || view->index.offsets[avm_kernel_config_tags_version_info] + sizeof(*version) > view->size) return;
+
+	outputPrintf(output, "\n\tAVM_VERSION_INFO\t\"%s\", \"%s\", \"%s\"\n", version->buildnumber, version->svnversion, version->firmwarestring);
+
+}
+
+static void processModuleMemoryEntries(struct outputBuffer *output, const struct configAreaView *view)
+{
+	struct configAreaModule	module;
+	unsigned int			mod_no = 0;
+
+	outputPrintf(output, "\n.L_avm_module_memory:\n");
+	while (getConfigAreaModule(view, mod_no, &module))
+	{
+		outputPrintf(output, "\tAVM_MODULE_MEMORY\t%u, \"%s\", %u, %u, %u\n", ++mod_no, module.name, module.coreSize, module.symbolSize, module.symbolTextSize);
+	}
+	outputPrintf(output, "\tAVM_MODULE_MEMORY\t0\n");
+
+}
+
+static int processConfigArea(struct outputBuffer *output, const struct configAreaView *view, const char *incbinPrefix)
+{
+	const struct configAreaIndex *	index = &view->index;
+	bool	outputModuleMemory = hasConfigAreaEntry(index, avm_kernel_config_tags_module_memory);
+	bool	outputVersionInfo = hasConfigAreaEntry(index, avm_kernel_config_tags_version_info);
+	bool	outputDeviceTrees = (index->subRevisions != 0);
+
+	outputPrintf(output, "#include \"avm_kernel_config_macros.h\"\n\n");
+
+	outputPrintf(output, "\tAVM_KERNEL_CONFIG_START\n\n");
+	outputPrintf(output, "\tAVM_KERNEL_CONFIG_PTR\n\n");
+	outputPrintf(output, ".L_avm_kernel_config_entries:\n");
+
+	if (outputModuleMemory) outputPrintf(output, "\tAVM_KERNEL_CONFIG_ENTRY\t%u, \"module_memory\"\n", avm_kernel_config_tags_module_memory);
+
+	if (outputVersionInfo) outputPrintf(output, "\tAVM_KERNEL_CONFIG_ENTRY\t%u, \"version_info\"\n", avm_kernel_config_tags_version_info);
+
+	// device tree for subrevision 0 is the fallback entry and may be expected
+	// as 'always present', if FDTs exist at all
+	for (unsigned int i = 0; i <= avm_kernel_config_tags_device_tree_subrev_last - avm_kernel_config_tags_device_tree_subrev_0; i++)
+	{
+		if (index->subRevisions & (1 << i))
+			outputPrintf(output, "\tAVM_KERNEL_CONFIG_ENTRY\t%u, \"device_tree_subrev_%u\"\n", avm_kernel_config_tags_device_tree_subrev_0 + i, i);
+	}
+
+	outputPrintf(output, "\tAVM_KERNEL_CONFIG_ENTRY\t0\n");
+
+	if (outputDeviceTrees) processDeviceTrees(output, view, incbinPrefix);
+	if (outputVersionInfo) processVersionInfo(output, view);
+	if (outputModuleMemory) processModuleMemoryEntries(output, view);
+
+	outputPrintf(output, "\n\tAVM_KERNEL_CONFIG_END\n\n");
+
+	return (outputFlush(output) ? 0 : 1);
+}
+
+int writeConfigAreaSource(const struct configAreaView *view, int fd, const char *incbinPrefix)
+{
+	struct outputBuffer		output = { .fd = fd };
+	int						result;
+
+	if ((output.buffer = malloc(OUTPUT_BUFFER_SIZE)) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the output buffer.\n", errno);
+		return 1;
+	}
+
+	result = processConfigArea(&output, view, incbinPrefix);
+	free(output.buffer);
+
+	return result;
+}
@@ -22,6 +22,13 @@
 
 #include "avm_kernel_config_helpers.h"
 
+unsigned int getConfigApiVersion(void)
+{
+
+	return AVM_KERNEL_CONFIG_API_VERSION;
+
+}
+
 bool openMemoryMappedFile(struct memoryMappedFile *file, const char *fileName, const char *fileDescription, int openFlags, int prot, int flags)
 {
 	bool			result = false;
@@ -73,16 +80,18 @@ void closeMemoryMappedFile(struct memoryMappedFile *file)
 
 }
 
-bool detectInputEndianess(struct _avm_kernel_config * *configArea, size_t configSize, bool *swapNeeded)
+bool detectInputEndianess(const void *configArea, size_t configSize, bool *swapNeeded)
 {
-	uint32_t *					arrayStart = NULL;
-	uint32_t *					arrayEnd = NULL;
-	uint32_t *					ptr = NULL;
-	uint32_t *					base = NULL;
+	const uint32_t *			area = (const uint32_t *) configArea;
+	const uint32_t *			arrayStart = NULL;
+	const uint32_t *			arrayEnd = NULL;
+	const uint32_t *			ptr = NULL;
+	const uint32_t *			ptrEnd = NULL;
+	const uint32_t *			base = NULL;
+	const uint32_t *			entry;
 	uint32_t					offset;
 	uint32_t					tag;
 	uint32_t					ptrValue;
-	struct _avm_kernel_config *	entry;
 	bool						assumeSwapped = false;
 
 	//	- a 32-bit value with more than one byte containing a non-zero value
@@ -94,12 +103,16 @@ bool detectInputEndianess(struct _avm_kernel_config * *configArea, size_t config
 	//	- we'll stop at the second 'end of array' marker, assuming we've
 	//	  reached the end of 'struct _avm_kernel_config' array, the tag at
 	//	  this array entry should be equal to avm_kernel_config_tags_last
-	//	- limit search to first 16 KB (4096 * sizeof(uint32_t)), if the whole
+	//	- limit search to first 64 KB (4096 * sizeof(uint32_t) words), if the whole
 	//	  area is empty
+	//	- each entry of the array consists of two 32-bit values (tag and pointer)
+	//	  on the target, regardless of the pointer size of the host
 
-	ptr = (uint32_t *) configArea;
+	ptr = area;
+	ptrEnd = area + (configSize / sizeof(uint32_t));
+	if (ptrEnd > area + (4096 * sizeof(uint32_t)) + 1) ptrEnd = area + (4096 * sizeof(uint32_t)) + 1;
 
-	while (ptr <= ((uint32_t *) configArea) + (4096 * sizeof(uint32_t)))
+	while (ptr < ptrEnd)
 	{
 		if (*ptr == 0)
 		{
@@ -128,25 +141,25 @@ bool detectInputEndianess(struct _avm_kernel_config * *configArea, size_t config
 	if (base == NULL || arrayStart == NULL || arrayEnd == NULL) return false;
 
 	// check avm_kernel_config_tags_last entry first
-	entry = (struct _avm_kernel_config *) arrayEnd - 1;
-	tag = entry->tag;
+	entry = arrayEnd - 2;
+	tag = entry[0];
 	if (tag == 0) return false;
 
 	// set assumption
 	assumeSwapped = (tag <= avm_kernel_config_tags_last ? false : true);
 
 	// check other tags
-	entry = (struct _avm_kernel_config *) arrayStart;
+	entry = arrayStart;
 	do
 	{
-		tag = entry->tag;
+		tag = entry[0];
 		swapEndianess(assumeSwapped, &tag);
 		// invalid value means, our assumption was wrong
 		if (tag != 0 && tag > avm_kernel_config_tags_last) return false;
 		if (tag == avm_kernel_config_tags_last) break;
-		entry++;
+		entry += 2;
 	}
-	while (entry->config != NULL);
+	while (entry + 2 <= ptrEnd && entry[1] != 0);
 
 	// now we compute offset in kernel
 	ptrValue = *base;
@@ -154,28 +167,142 @@ bool detectInputEndianess(struct _avm_kernel_config * *configArea, size_t config
 	offset = ptrValue & 0xFFFFF000;
 
 	// first value has to point to the array
-	if ((ptrValue - offset) != ((uint32_t) arrayStart - (uint32_t) configArea))
+	if ((ptrValue - offset) != (uint32_t) ((arrayStart - area) * sizeof(uint32_t)))
 		return false;
 
 	// check each entry->config pointer, if its value is in range
-	entry = (struct _avm_kernel_config *) arrayStart;
+	entry = arrayStart;
 	do
 	{
-		ptrValue = (uint32_t) entry->config;
+		ptrValue = entry[1];
 		swapEndianess(assumeSwapped, &ptrValue);
 
 		if (ptrValue <= offset) return false; // points before, impossible
 		if (ptrValue - offset > configSize) return false; // points after
 		if (tag == avm_kernel_config_tags_last) break;
-		entry++;
+		entry += 2;
 	}
-	while (entry->config != NULL);
+	while (entry + 2 <= ptrEnd && entry[1] != 0);
 
 	// we may be sure here, that the endianess was detected successful
 	*swapNeeded = assumeSwapped;
 	return true;
 }
 
+bool indexConfigArea(const void *configArea, size_t configSize, struct configAreaIndex *index)
+{
+	const uint32_t *	area = (const uint32_t *) configArea;
+	const uint32_t *	areaEnd = area + (configSize / sizeof(uint32_t));
+	const uint32_t *	entry;
+	uint32_t			ptrValue;
+	uint32_t			tag;
+	uint32_t			config;
+
+	//	- walks the entries array of a dump, which was not relocated yet, each entry consists of two 32-bit values
+	//	  (the tag and the pointer to its data)
+	//	- every question regarding the presence or the location of an entry should be answered from this index
+	//	  later, without any further walk through the array
+
+	memset(index, 0, sizeof(*index));
+
+	if (!detectInputEndianess(configArea, configSize, &index->swapNeeded)) return false;
+
+	ptrValue = *area;
+	swapEndianess(index->swapNeeded, &ptrValue);
+	index->kernelOffset = ptrValue & 0xFFFFF000;
+	index->entriesOffset = ptrValue - index->kernelOffset;
+	entry = area + (index->entriesOffset / sizeof(uint32_t));
+
+	while ((entry + 2) <= areaEnd)
+	{
+		tag = *entry;
+		config = *(entry + 1);
+		swapEndianess(index->swapNeeded, &tag);
+		swapEndianess(index->swapNeeded, &config);
+
+		if (config == 0 || tag > avm_kernel_config_tags_last) break;
+
+		if (config > index->kernelOffset && config - index->kernelOffset < configSize && index->offsets[tag] == 0)
+		{
+			index->offsets[tag] = config - index->kernelOffset;
+			if (tag >= avm_kernel_config_tags_device_tree_subrev_0 && tag <= avm_kernel_config_tags_device_tree_subrev_last)
+				index->subRevisions |= 1 << (tag - avm_kernel_config_tags_device_tree_subrev_0);
+		}
+		index->entries++;
+
+		if (tag == avm_kernel_config_tags_last) break;
+
+		entry += 2;
+	}
+
+	return true;
+}
+
+//	read-only view of a config area
+//
+//	- the dump is used as it was read from the kernel, nothing gets relocated or swapped in place
+//	- kernel addresses are translated to locations in the dump and values are converted to the byte
+//	  order of the host on each access
+//	- each entry of the module memory table occupies four 32-bit values on the target (name pointer,
+//	  core size, symbol size, symbol text size)
+
+#define MODULE_ENTRY_SIZE		(4 * sizeof(uint32_t))
+
+bool openConfigAreaView(struct configAreaView *view, const void *configArea, size_t configSize)
+{
+
+	view->area = (const uint8_t *) configArea;
+	view->size = configSize;
+
+	return indexConfigArea(configArea, configSize, &view->index);
+}
+
+uint32_t getConfigAreaValue(const struct configAreaView *view, size_t offset)
+{
+	uint32_t			value;
+
+	if (offset + sizeof(uint32_t) > view->size) return 0;
+
+	memcpy(&value, view->area + offset, sizeof(uint32_t));
+	swapEndianess(view->index.swapNeeded, &value);
+
+	return value;
+}
+
+const void * translateConfigAreaAddress(const struct configAreaView *view, uint32_t address, size_t size)
+{
+	uint32_t			offset;
+
+	if (address <= view->index.kernelOffset) return NULL;
+
+	offset = address - view->index.kernelOffset;
+	if (offset >= view->size || size > view->size - offset) return NULL;
+
+	return view->area + offset;
+}
+
+bool getConfigAreaModule(const struct configAreaView *view, unsigned int number, struct configAreaModule *module)
+{
+	size_t				offset;
+	const char *		name;
+
+	if (!hasConfigAreaEntry(&view->index, avm_kernel_config_tags_module_memory)) return false;
+
+	offset = view->index.offsets[avm_kernel_config_tags_module_memory] + ((size_t) number * MODULE_ENTRY_SIZE);
+	if (offset + MODULE_ENTRY_SIZE > view->size) return false;
+
+	// a NULL pointer as name marks the end of the table, the name has to end within the area
+	if ((name = translateConfigAreaAddress(view, getConfigAreaValue(view, offset), 1)) == NULL) return false;
+	if (memchr(name, 0, view->size - (name - (const char *) view->area)) == NULL) return false;
+
+	module->name = name;
+	module->coreSize = getConfigAreaValue(view, offset + sizeof(uint32_t));
+	module->symbolSize = getConfigAreaValue(view, offset + 2 * sizeof(uint32_t));
+	module->symbolTextSize = getConfigAreaValue(view, offset + 3 * sizeof(uint32_t));
+
+	return true;
+}
+
 void swapEndianess(bool needed, uint32_t *ptr)
 {
 
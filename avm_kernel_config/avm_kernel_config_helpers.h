@@ -13,6 +13,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <unistd.h>
 #include <stdbool.h>
@@ -21,6 +22,11 @@
 #include <sys/fcntl.h>
 #include <sys/mman.h>
 
+//	- the functions declared here are available as library 'libavmkconfig' (static and shared), the
+//	  API version is incremented for each incompatible change of a structure or a function prototype
+
+#define AVM_KERNEL_CONFIG_API_VERSION	1
+
 struct memoryMappedFile
 {
 	const char *		fileName;
@@ -31,9 +37,90 @@ struct memoryMappedFile
 	bool				fileMapped;
 };
 
+struct packedKernelHeader
+{
+	uint32_t			compressedSize;
+	uint32_t			uncompressedSize;
+	size_t				streamOffset;
+	uint8_t				lzmaHeader[13];
+};
+
+//	- index of the entries in a (not relocated) config area, built with a single pass over the
+//	  'struct _avm_kernel_config' array
+//	- 'offsets' contains the offset of the data for each tag (from the start of the area), the
+//	  first occurrence of a tag wins and a value of 0 means, there's no such entry
+
+struct configAreaIndex
+{
+	bool				swapNeeded;
+	uint32_t			kernelOffset;
+	uint32_t			entriesOffset;
+	unsigned int		entries;
+	unsigned int		subRevisions;
+	uint32_t			offsets[avm_kernel_config_tags_last + 1];
+};
+
+//	- read-only view of a config area, values and kernel addresses are translated on access
+
+struct configAreaView
+{
+	const uint8_t *		area;
+	size_t				size;
+	struct configAreaIndex	index;
+};
+
+struct configAreaModule
+{
+	const char *		name;
+	uint32_t			coreSize;
+	uint32_t			symbolSize;
+	uint32_t			symbolTextSize;
+};
+
+//	- prepared search for a DTB image in a kernel, see avm_kernel_config_search.c
+
+struct deviceTreeSearch
+{
+	uint32_t *			needle;
+	size_t				needleSize;
+	size_t				needleWords;
+	uint32_t *			skipTable;
+};
+
+unsigned int getConfigApiVersion(void);
 bool openMemoryMappedFile(struct memoryMappedFile *file, const char *fileName, const char *fileDescription, int openFlags, int prot, int flags);
 void closeMemoryMappedFile(struct memoryMappedFile *file);
-bool detectInputEndianess(struct _avm_kernel_config * *configArea, size_t configSize, bool *swapNeeded);
+bool parsePackedKernelHeader(const void *image, size_t imageSize, struct packedKernelHeader *header);
+bool unpackMemoryMappedFile(struct memoryMappedFile *packed, struct memoryMappedFile *unpacked);
+bool streamPackedKernel(int fd, const char *fileName, size_t configSize, void *configArea, size_t *areaOffset, unsigned int *matches);
+bool detectInputEndianess(const void *configArea, size_t configSize, bool *swapNeeded);
+bool indexConfigArea(const void *configArea, size_t configSize, struct configAreaIndex *index);
+bool openConfigAreaView(struct configAreaView *view, const void *configArea, size_t configSize);
+uint32_t getConfigAreaValue(const struct configAreaView *view, size_t offset);
+const void * translateConfigAreaAddress(const struct configAreaView *view, uint32_t address, size_t size);
+bool getConfigAreaModule(const struct configAreaView *view, unsigned int number, struct configAreaModule *module);
 void swapEndianess(bool needed, uint32_t *ptr);
+bool checkConfigArea(void *configArea, size_t configSize);
+void * findConfigArea(void *dtbLocation, size_t size);
+bool prepareDeviceTreeSearch(struct deviceTreeSearch *search, void *needle, size_t needleSize);
+void releaseDeviceTreeSearch(struct deviceTreeSearch *search);
+void * findNextDeviceTreeImage(struct deviceTreeSearch *search, void *haystack, size_t haystackSize, void *previous);
+void * findDeviceTreeImage(void *haystack, size_t haystackSize, void *needle, size_t needleSize);
+void * locateNextDeviceTreeSignature(void *kernelBuffer, size_t kernelSize, void *previous);
+void * locateDeviceTreeSignature(void *kernelBuffer, size_t kernelSize);
+bool openKernelImage(struct memoryMappedFile *kernel, const char *fileName, bool unpack);
+void * nextDeviceTreeLocation(void *kernelBuffer, size_t kernelSize, struct deviceTreeSearch *search, void *previous);
+void * locateConfigArea(void *kernelBuffer, size_t kernelSize, struct deviceTreeSearch *search, size_t size, unsigned int *matches);
+int writeConfigAreaSource(const struct configAreaView *view, int fd, const char *incbinPrefix);
+
+static inline bool hasConfigAreaEntry(const struct configAreaIndex *index, unsigned int tag)
+{
+	return (tag <= avm_kernel_config_tags_last && index->offsets[tag] != 0);
+}
+
+static inline const void * getConfigAreaEntry(const void *configArea, const struct configAreaIndex *index, unsigned int tag)
+{
+	return (hasConfigAreaEntry(index, tag) ? (const uint8_t *) configArea + index->offsets[tag] : NULL);
+}
 
 #endif
@@ -0,0 +1,302 @@
+// vim: set tabstop=4 syntax=c :
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/***********************************************************************
+ *                                                                     *
+ *                                                                     *
+ * Copyright (C) 2016-2021 P.Hämmerlein (http://www.yourfritz.de)      *
+ *                                                                     *
+ * This program is free software; you can redistribute it and/or       *
+ * modify it under the terms of the GNU General Public License         *
+ * as published by the Free Software Foundation; either version 2      *
+ * of the License, or (at your option) any later version.              *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program, please look for the file COPYING.          *
+ *                                                                     *
+ ***********************************************************************/
+
+#include "avm_kernel_config_helpers.h"
+#include <libfdt.h>
+
+bool checkConfigArea(void *configArea, size_t configSize)
+{
+	bool			swapNeeded = false;
+
+	if (!detectInputEndianess(configArea, configSize, &swapNeeded)) return false;
+	return true;
+}
+
+void * findConfigArea(void *dtbLocation, size_t size)
+{
+	void *							configArea = NULL;
+
+	// previous 4K boundary should be the start of the config area
+	configArea = (void *) (((uintptr_t) dtbLocation >> 12) << 12);
+
+	if (checkConfigArea(configArea, size)) return configArea;
+
+	return NULL;
+}
+
+//	DTB search engine
+//
+//	- the DTB image is only searched at 32-bit aligned locations, the linker places it at least on such a boundary
+//	- long needles are searched with a Boyer-Moore-Horspool variant working on 32-bit words, the skip table is
+//	  indexed with a hash of the word, which was found at the end of the current search window
+//	- short needles (and the FDT signature scan) use a scan for the first word, this scan is done with SSE2 or AVX2
+//	  instructions, if the CPU supports them - the implementation is selected at runtime
+
+#define SEARCH_HASH_BITS		16
+#define SEARCH_HASH(word)		((uint32_t) ((word) * 0x9E3779B1) >> (32 - SEARCH_HASH_BITS))
+#define SEARCH_MIN_WORDS		32
+
+typedef uint32_t * (*findWordFunction)(uint32_t *from, uint32_t *to, uint32_t value);
+
+static uint32_t * findWordGeneric(uint32_t *from, uint32_t *to, uint32_t value)
+{
+
+	while (from < to)
+	{
+		if (*from == value) return from;
+		from++;
+	}
+
+	return NULL;
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static uint32_t * findWordSSE2(uint32_t *from, uint32_t *to, uint32_t value)
+{
+	__m128i			lookFor = _mm_set1_epi32((int) value);
+
+	while (to - from >= 4)
+	{
+		int			mask = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((__m128i *) from), lookFor));
+
+		if (mask) return from + (__builtin_ctz(mask) >> 2);
+		from += 4;
+	}
+
+	return findWordGeneric(from, to, value);
+}
+
+__attribute__((target("avx2")))
+static uint32_t * findWordAVX2(uint32_t *from, uint32_t *to, uint32_t value)
+{
+	__m256i			lookFor = _mm256_set1_epi32((int) value);
+
+	while (to - from >= 8)
+	{
+		int			mask = _mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_loadu_si256((__m256i *) from), lookFor));
+
+		if (mask) return from + (__builtin_ctz((unsigned int) mask) >> 2);
+		from += 8;
+	}
+
+	return findWordGeneric(from, to, value);
+}
+#endif
+
+static findWordFunction selectFindWord(void)
+{
+	static findWordFunction		selected = NULL;
+
+	if (selected != NULL) return selected;
+
+	selected = findWordGeneric;
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) selected = findWordAVX2;
+	else if (__builtin_cpu_supports("sse2")) selected = findWordSSE2;
+#endif
+
+	return selected;
+}
+
+bool prepareDeviceTreeSearch(struct deviceTreeSearch *search, void *needle, size_t needleSize)
+{
+	search->needle = (uint32_t *) needle;
+	search->needleSize = needleSize;
+	search->needleWords = needleSize / sizeof(uint32_t);
+	search->skipTable = NULL;
+
+	if (search->needleWords == 0) return false;
+
+	if (search->needleWords >= SEARCH_MIN_WORDS)
+	{
+		uint32_t	count = 1 << SEARCH_HASH_BITS;
+		uint32_t	last = search->needleWords - 1;
+
+		if ((search->skipTable = (uint32_t *) malloc(count * sizeof(uint32_t))) == NULL)
+		{
+			fprintf(stderr, "Error %d allocating memory for the search engine.\n", errno);
+			return false;
+		}
+
+		// different words with the same hash value share an entry, later (smaller) distances replace earlier ones,
+		// so the shift value is always the safe one
+		for (uint32_t i = 0; i < count; i++) search->skipTable[i] = last + 1;
+		for (uint32_t i = 0; i < last; i++) search->skipTable[SEARCH_HASH(search->needle[i])] = last - i;
+	}
+
+	selectFindWord();
+
+	return true;
+}
+
+void releaseDeviceTreeSearch(struct deviceTreeSearch *search)
+{
+
+	if (search->skipTable != NULL)
+	{
+		free(search->skipTable);
+		search->skipTable = NULL;
+	}
+
+}
+
+void * findNextDeviceTreeImage(struct deviceTreeSearch *search, void *haystack, size_t haystackSize, void *previous)
+{
+	uint32_t *	words = (uint32_t *) haystack;
+	size_t		last;
+	size_t		position;
+
+	if (search->needleSize > haystackSize) return NULL;
+
+	// the last position, where the whole needle still fits into the haystack
+	last = (haystackSize - search->needleSize) / sizeof(uint32_t);
+	position = (previous == NULL ? 0 : ((uint32_t *) previous - words) + 1);
+
+	if (search->skipTable == NULL)
+	{
+		findWordFunction	findWord = selectFindWord();
+		uint32_t *			end = words + last + 1;
+		uint32_t *			candidate = words + position;
+
+		if (position > last) return NULL;
+
+		while ((candidate = findWord(candidate, end, *search->needle)) != NULL)
+		{
+			if (memcmp(candidate, search->needle, search->needleSize) == 0) return candidate;
+			candidate++;
+		}
+	}
+	else
+	{
+		uint32_t	lastWord = search->needle[search->needleWords - 1];
+		size_t		lastIndex = search->needleWords - 1;
+
+		
+		while (position <= last)
+		{
+			uint32_t	word = words[position + lastIndex];
+
+			if (word == lastWord)
+			{
+				if (memcmp(words + position, search->needle, search->needleSize) == 0)
+					return words + position;
+			}
+			position += search->skipTable[SEARCH_HASH(word)];
+		}
+	}
+
+	return NULL;
+}
+
+void * findDeviceTreeImage(void *haystack, size_t haystackSize, void *needle, size_t needleSize)
+{
+	struct deviceTreeSearch	search;
+	void *					location = NULL;
+
+	if (prepareDeviceTreeSearch(&search, needle, needleSize))
+	{
+		location = findNextDeviceTreeImage(&search, haystack, haystackSize, NULL);
+		releaseDeviceTreeSearch(&search);
+	}
+
+	return location;
+}
+
+void * locateNextDeviceTreeSignature(void *kernelBuffer, size_t kernelSize, void *previous)
+{
+	findWordFunction	findWord = selectFindWord();
+	uint32_t			signature = 0xD00DFEED;
+	uint32_t *			ptr = (previous == NULL ? (uint32_t *) kernelBuffer : ((uint32_t *) previous) + 1);
+	uint32_t *			end = (uint32_t *) kernelBuffer + (kernelSize / sizeof(uint32_t));
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	// the DTB signature is store in 'big endian' => swap needed, if we're running on 'little endian' machine
+	swapEndianess(true, &signature);
+#endif
+
+	while ((ptr = findWord(ptr, end, signature)) != NULL)
+	{
+		// the header has to fit into the remaining buffer
+		if ((size_t) (end - ptr) * sizeof(uint32_t) >= sizeof(struct fdt_header) && fdt_check_header((void *) ptr) == 0)
+			return ptr;
+		ptr++;
+	}
+
+	return NULL;
+}
+
+void * locateDeviceTreeSignature(void *kernelBuffer, size_t kernelSize)
+{
+
+	return locateNextDeviceTreeSignature(kernelBuffer, kernelSize, NULL);
+
+}
+
+bool openKernelImage(struct memoryMappedFile *kernel, const char *fileName, bool unpack)
+{
+	struct memoryMappedFile		image;
+	bool						result;
+
+	if (!unpack) return openMemoryMappedFile(kernel, fileName, "unpacked kernel", O_RDONLY | O_SYNC, PROT_READ, MAP_SHARED);
+
+	// the packed image is only needed, until it was decompressed to an anonymous mapping
+	if (!openMemoryMappedFile(&image, fileName, "packed kernel", O_RDONLY | O_SYNC, PROT_READ, MAP_SHARED)) return false;
+	result = unpackMemoryMappedFile(&image, kernel);
+	closeMemoryMappedFile(&image);
+
+	return result;
+}
+
+void * nextDeviceTreeLocation(void *kernelBuffer, size_t kernelSize, struct deviceTreeSearch *search, void *previous)
+{
+
+	if (search != NULL) return findNextDeviceTreeImage(search, kernelBuffer, kernelSize, previous);
+	return locateNextDeviceTreeSignature(kernelBuffer, kernelSize, previous);
+
+}
+
+void * locateConfigArea(void *kernelBuffer, size_t kernelSize, struct deviceTreeSearch *search, size_t size, unsigned int *matches)
+{
+	void *							dtbLocation = NULL;
+	void *							configArea = NULL;
+
+	*matches = 0;
+
+	// try each location, until the surrounding area looks like a config area
+	while ((dtbLocation = nextDeviceTreeLocation(kernelBuffer, kernelSize, search, dtbLocation)) != NULL)
+	{
+		size_t						areaOffset = ((dtbLocation - kernelBuffer) >> 12) << 12;
+
+		(*matches)++;
+
+		// the area has to be completely contained in the kernel image
+		if (areaOffset + size > kernelSize) continue;
+
+		if ((configArea = findConfigArea(dtbLocation, size)) != NULL) break;
+	}
+
+	return configArea;
+}
@@ -0,0 +1,331 @@
+// vim: set tabstop=4 syntax=c :
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/***********************************************************************
+ *                                                                     *
+ *                                                                     *
+ * Copyright (C) 2016-2021 P.Hämmerlein (http://www.yourfritz.de)      *
+ *                                                                     *
+ * This program is free software; you can redistribute it and/or       *
+ * modify it under the terms of the GNU General Public License         *
+ * as published by the Free Software Foundation; either version 2      *
+ * of the License, or (at your option) any later version.              *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program, please look for the file COPYING.          *
+ *                                                                     *
+ ***********************************************************************/
+
+// MAP_ANONYMOUS isn't visible in strict C99 mode otherwise
+#define _DEFAULT_SOURCE
+
+#include "avm_kernel_config_helpers.h"
+#include <libfdt.h>
+#include <lzma.h>
+
+//	native implementation of 'unpack_kernel.sh' (see there for a description of the MIPS kernel image)
+//
+//	- all values in the kernel header are stored in 'little endian' order
+//	- the LZMA header is searched within the next 128 byte after its usual offset (in 32-bit steps), to accommodate
+//	  to different offsets used for some models - if it can't be found, the usual offsets are used
+//	- the decoder gets the LZMA properties from the image, followed by the uncompressed size as 64-bit value, this is
+//	  the format expected by 'lzma_alone_decoder' (and by 'lzma -d')
+
+#define KERNEL_COMPLEN_OFFSET		16
+#define KERNEL_UNCOMPLEN_OFFSET		20
+#define KERNEL_LZMAHDR_OFFSET		28
+#define KERNEL_LZMAHDR_SIZE			5
+#define KERNEL_LZMAHDR_PROBE		128
+#define KERNEL_STREAM_OFFSET		36
+
+static const uint8_t	lzmaHeaderContent[KERNEL_LZMAHDR_SIZE] = { 0x5D, 0x00, 0x80, 0x00, 0x00 };
+
+static uint32_t getLittleEndianValue(const uint8_t *ptr)
+{
+
+	return (uint32_t) *ptr | (uint32_t) *(ptr + 1) << 8 | (uint32_t) *(ptr + 2) << 16 | (uint32_t) *(ptr + 3) << 24;
+
+}
+
+bool parsePackedKernelHeader(const void *image, size_t imageSize, struct packedKernelHeader *header)
+{
+	const uint8_t *		ptr = (const uint8_t *) image;
+	size_t				delta = 0;
+
+	if (imageSize < KERNEL_STREAM_OFFSET)
+	{
+		fprintf(stderr, "The packed kernel image is too small (%zu bytes).\n", imageSize);
+		return false;
+	}
+
+	for (size_t offset = 0; offset <= KERNEL_LZMAHDR_PROBE; offset += sizeof(uint32_t))
+	{
+		if (KERNEL_STREAM_OFFSET + offset > imageSize) break;
+		if (memcmp(ptr + KERNEL_LZMAHDR_OFFSET + offset, lzmaHeaderContent, KERNEL_LZMAHDR_SIZE) == 0)
+		{
+			delta = offset;
+			break;
+		}
+	}
+
+	header->compressedSize = getLittleEndianValue(ptr + KERNEL_COMPLEN_OFFSET + delta);
+	header->uncompressedSize = getLittleEndianValue(ptr + KERNEL_UNCOMPLEN_OFFSET + delta);
+	header->streamOffset = KERNEL_STREAM_OFFSET + delta;
+
+	// the decoder expects the properties followed by the uncompressed size as 64-bit value
+	memcpy(header->lzmaHeader, ptr + KERNEL_LZMAHDR_OFFSET + delta, KERNEL_LZMAHDR_SIZE);
+	for (int i = 0; i < 8; i++)
+		header->lzmaHeader[KERNEL_LZMAHDR_SIZE + i] = (i < 4 ? (uint8_t) (header->uncompressedSize >> (i * 8)) : 0);
+
+	if (header->uncompressedSize == 0)
+	{
+		fprintf(stderr, "The packed kernel image contains an invalid uncompressed size.\n");
+		return false;
+	}
+
+	return true;
+}
+
+bool unpackMemoryMappedFile(struct memoryMappedFile *packed, struct memoryMappedFile *unpacked)
+{
+	struct packedKernelHeader	header;
+	lzma_stream					stream = LZMA_STREAM_INIT;
+	lzma_ret					lzmaResult;
+	bool						result = false;
+
+	unpacked->fileName = packed->fileName;
+	unpacked->fileDescription = "unpacked kernel";
+	unpacked->fileDescriptor = -1;
+	unpacked->fileBuffer = NULL;
+	unpacked->fileMapped = false;
+	memset(&unpacked->fileStat, 0, sizeof(unpacked->fileStat));
+
+	if (!parsePackedKernelHeader(packed->fileBuffer, packed->fileStat.st_size, &header)) return false;
+
+	if (header.compressedSize > packed->fileStat.st_size - header.streamOffset)
+	{
+		fprintf(stderr, "The packed kernel image is truncated, %u bytes of compressed data expected.\n", header.compressedSize);
+		return false;
+	}
+
+	if ((unpacked->fileBuffer = mmap(NULL, header.uncompressedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+	{
+		fprintf(stderr, "Error %d mapping %u bytes of memory for the unpacked kernel.\n", errno, header.uncompressedSize);
+		unpacked->fileBuffer = NULL;
+		return false;
+	}
+	unpacked->fileMapped = true;
+	unpacked->fileStat.st_size = header.uncompressedSize;
+
+	if ((lzmaResult = lzma_alone_decoder(&stream, UINT64_MAX)) == LZMA_OK)
+	{
+		stream.next_in = header.lzmaHeader;
+		stream.avail_in = sizeof(header.lzmaHeader);
+		stream.next_out = unpacked->fileBuffer;
+		stream.avail_out = header.uncompressedSize;
+
+		if ((lzmaResult = lzma_code(&stream, LZMA_RUN)) == LZMA_OK)
+		{
+			stream.next_in = (const uint8_t *) packed->fileBuffer + header.streamOffset;
+			stream.avail_in = header.compressedSize;
+
+			lzmaResult = lzma_code(&stream, LZMA_FINISH);
+		}
+
+		if (lzmaResult == LZMA_STREAM_END || (lzmaResult == LZMA_OK && stream.avail_out == 0))
+		{
+			mprotect(unpacked->fileBuffer, header.uncompressedSize, PROT_READ);
+			result = true;
+		}
+		else fprintf(stderr, "Error %d unpacking kernel image '%s', %zu of %u bytes were decompressed.\n", lzmaResult, packed->fileName, (size_t) (header.uncompressedSize - stream.avail_out), header.uncompressedSize);
+
+		lzma_end(&stream);
+	}
+	else fprintf(stderr, "Error %d initializing the LZMA decoder.\n", lzmaResult);
+
+	if (result == false) closeMemoryMappedFile(unpacked);
+
+	return result;
+}
+
+//	streaming scanner for packed kernels
+//
+//	- the kernel is decompressed in chunks into a window buffer, which starts always at a 4K boundary of the unpacked
+//	  kernel, and each 32-bit aligned location is checked for the FDT signature and a valid FDT header
+//	- the config area starts at the previous 4K boundary of such a location, if it was found, decompression goes on
+//	  until the whole area is present in the window and it's checked with 'detectInputEndianess' then
+//	- data in front of the 4K boundary of the next location to check isn't needed anymore and is removed from the
+//	  window, so the window never needs more than the area size, a 4K page and one chunk of output data
+//	- decompression stops with the first accepted area, the input is read with 'read' calls, so pipes and character
+//	  devices may be used, too
+
+#define STREAM_CHUNK_SIZE			(64 * 1024)
+#define STREAM_HEADER_SIZE			(KERNEL_STREAM_OFFSET + KERNEL_LZMAHDR_PROBE)
+
+static ssize_t readInput(int fd, uint8_t *buffer, size_t size)
+{
+	size_t			done = 0;
+	ssize_t			count;
+
+	while (done < size)
+	{
+		if ((count = read(fd, buffer + done, size - done)) == -1)
+		{
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if (count == 0) break;
+		done += count;
+	}
+
+	return done;
+}
+
+bool streamPackedKernel(int fd, const char *fileName, size_t configSize, void *configArea, size_t *areaOffset, unsigned int *matches)
+{
+	struct packedKernelHeader	header;
+	lzma_stream					stream = LZMA_STREAM_INIT;
+	lzma_ret					lzmaResult = LZMA_OK;
+	uint8_t *					input = malloc(STREAM_CHUNK_SIZE);
+	size_t						windowSize = configSize + 4096 + STREAM_CHUNK_SIZE;
+	uint8_t *					window = malloc(windowSize);
+	size_t						windowBase = 0;		// offset of the first window byte in the unpacked kernel
+	size_t						windowFill = 0;		// number of valid bytes in the window
+	size_t						scanned = 0;		// offset of the next location to check in the unpacked kernel
+	size_t						remaining;			// compressed bytes not read yet
+	ssize_t						inputSize;
+	uint32_t					signature = 0xD00DFEED;
+	bool						swapNeeded;
+	bool						finished = false;
+	bool						found = false;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	// the DTB signature is store in 'big endian' => swap needed, if we're running on 'little endian' machine
+	swapEndianess(true, &signature);
+#endif
+
+	*matches = 0;
+
+	if (input == NULL || window == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the streaming scanner.\n", errno);
+		free(input);
+		free(window);
+		return false;
+	}
+
+	if ((inputSize = readInput(fd, input, STREAM_HEADER_SIZE)) == -1)
+	{
+		fprintf(stderr, "Error %d reading packed kernel image '%s'.\n", errno, fileName);
+		finished = true;
+	}
+	else if (!parsePackedKernelHeader(input, inputSize, &header))
+	{
+		finished = true;
+	}
+	else if ((lzmaResult = lzma_alone_decoder(&stream, UINT64_MAX)) != LZMA_OK)
+	{
+		fprintf(stderr, "Error %d initializing the LZMA decoder.\n", lzmaResult);
+		finished = true;
+	}
+	else
+	{
+		stream.next_in = header.lzmaHeader;
+		stream.avail_in = sizeof(header.lzmaHeader);
+		stream.next_out = window;
+		stream.avail_out = windowSize;
+
+		if ((lzmaResult = lzma_code(&stream, LZMA_RUN)) != LZMA_OK)
+		{
+			fprintf(stderr, "Error %d initializing the LZMA decoder.\n", lzmaResult);
+			finished = true;
+		}
+
+		// the remaining data from the first read is the start of the compressed stream
+		remaining = header.compressedSize;
+		stream.next_in = input + header.streamOffset;
+		stream.avail_in = ((size_t) inputSize > header.streamOffset ? inputSize - header.streamOffset : 0);
+		if (stream.avail_in > remaining) stream.avail_in = remaining;
+		remaining -= stream.avail_in;
+	}
+
+	while (!finished && !found)
+	{
+		size_t					keep;
+
+		// decompress the next chunk
+		if (stream.avail_in == 0 && remaining > 0)
+		{
+			if ((inputSize = readInput(fd, input, (remaining > STREAM_CHUNK_SIZE ? STREAM_CHUNK_SIZE : remaining))) == -1)
+			{
+				fprintf(stderr, "Error %d reading packed kernel image '%s'.\n", errno, fileName);
+				break;
+			}
+			if (inputSize == 0)
+			{
+				fprintf(stderr, "The packed kernel image is truncated, %zu bytes of compressed data are missing.\n", remaining);
+				break;
+			}
+			stream.next_in = input;
+			stream.avail_in = inputSize;
+			remaining -= inputSize;
+		}
+
+		stream.next_out = window + windowFill;
+		stream.avail_out = (windowSize - windowFill > STREAM_CHUNK_SIZE ? STREAM_CHUNK_SIZE : windowSize - windowFill);
+
+		lzmaResult = lzma_code(&stream, (remaining == 0 ? LZMA_FINISH : LZMA_RUN));
+		windowFill = stream.next_out - window;
+
+		if (lzmaResult == LZMA_STREAM_END) finished = true;
+		else if (lzmaResult != LZMA_OK)
+		{
+			fprintf(stderr, "Error %d unpacking kernel image '%s' at offset %zu of the unpacked data.\n", lzmaResult, fileName, windowBase + windowFill);
+			break;
+		}
+
+		// check each new location, the FDT header has to be present completely
+		while (scanned + sizeof(struct fdt_header) <= windowBase + windowFill)
+		{
+			uint8_t *			location = window + (scanned - windowBase);
+
+			if (*((uint32_t *) location) == signature && fdt_check_header(location) == 0)
+			{
+				size_t			areaStart = (scanned >> 12) << 12;
+
+				// wait for the rest of the area
+				if (areaStart + configSize > windowBase + windowFill && !finished) break;
+
+				(*matches)++;
+
+				if (areaStart + configSize <= windowBase + windowFill && detectInputEndianess(window + (areaStart - windowBase), configSize, &swapNeeded))
+				{
+					memcpy(configArea, window + (areaStart - windowBase), configSize);
+					*areaOffset = areaStart;
+					found = true;
+					break;
+				}
+			}
+			scanned += sizeof(uint32_t);
+		}
+
+		// remove data, which isn't needed for the next location to check
+		keep = (scanned >> 12) << 12;
+		if (!found && keep > windowBase)
+		{
+			memmove(window, window + (keep - windowBase), windowFill - (keep - windowBase));
+			windowFill -= (keep - windowBase);
+			windowBase = keep;
+		}
+	}
+
+	lzma_end(&stream);
+	free(input);
+	free(window);
+
+	return found;
+}
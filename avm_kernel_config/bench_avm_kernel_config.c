@@ -0,0 +1,394 @@
+// vim: set tabstop=4 syntax=c :
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/***********************************************************************
+ *                                                                     *
+ *                                                                     *
+ * Copyright (C) 2016-2021 P.Hämmerlein (http://www.yourfritz.de)      *
+ *                                                                     *
+ * This program is free software; you can redistribute it and/or       *
+ * modify it under the terms of the GNU General Public License         *
+ * as published by the Free Software Foundation; either version 2      *
+ * of the License, or (at your option) any later version.              *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program, please look for the file COPYING.          *
+ *                                                                     *
+ ***********************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+#include "avm_kernel_config_helpers.h"
+#include <time.h>
+
+//	synthetic config area
+//
+//	- the layout is similar to the one from AVM's kernels: the pointer to the entries array at offset 0, the
+//	  entries array, the version info, the module memory table, the device trees (the first one within the
+//	  first 4K page of the area) and the module names at the end of the area
+//	- the device trees are valid FDT images with a single property containing random data
+
+#define AREA_SIZE				(64 * 1024)
+#define AREA_BASE				0x80A3B000
+#define AREA_ENTRIES			0x0010
+#define AREA_VERSION_INFO		0x0100
+#define AREA_MODULES			0x0200
+#define AREA_DEVICE_TREES		0x0800
+#define AREA_NAMES				0xE000
+#define MAX_MODULES				((AREA_DEVICE_TREES - AREA_MODULES) / 16 - 1)
+
+void usage()
+{
+
+	fprintf(stderr, "bench_avm_kernel_config - measure the stages of config area processing\n\n");
+	fprintf(stderr, "(C) 2016-2021 P. Hämmerlein (http://www.yourfritz.de)\n\n");
+	fprintf(stderr, "Licensed under GPLv2, see LICENSE file from source repository.\n\n");
+	fprintf(stderr, "Usage:\n\n");
+	fprintf(stderr, "bench_avm_kernel_config [ -s <kernel size in MByte> ] [ -e BE|LE ] [ -d <device trees> ] [ -m <modules> ] [ -r <rounds> ]\n");
+	fprintf(stderr, "\nA synthetic kernel image (random data) with a config area is built");
+	fprintf(stderr, "\nin memory, the area contains the specified number of device trees");
+	fprintf(stderr, "\n(1 to %u, default 4) and module memory entries (up to %u, default", avm_kernel_config_tags_device_tree_subrev_last - avm_kernel_config_tags_device_tree_subrev_0 + 1, (unsigned int) MAX_MODULES);
+	fprintf(stderr, "\n64) in the specified byte order (default BE). The kernel size is 32 MB,");
+	fprintf(stderr, "\nif it's not specified.\n");
+	fprintf(stderr, "\nEach stage (signature scan, DTB search, endianess detection, index");
+	fprintf(stderr, "\nand view setup, emission of the assembler source) is run for the");
+	fprintf(stderr, "\nspecified number of rounds (default 5) and the best time is used.");
+	fprintf(stderr, "\nThe throughput is computed from the size of the processed data (the");
+	fprintf(stderr, "\nkernel for the searches, the area for the other stages), the time per");
+	fprintf(stderr, "\nentry from the number of config area and module memory entries.\n");
+
+}
+
+static uint32_t	randomState = 0x2545F491;
+
+static uint32_t nextRandom(void)
+{
+
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+
+	return randomState;
+}
+
+static void fillRandom(uint8_t *buffer, size_t size)
+{
+	uint32_t			value;
+
+	while (size >= sizeof(uint32_t))
+	{
+		value = nextRandom();
+		memcpy(buffer, &value, sizeof(uint32_t));
+		buffer += sizeof(uint32_t);
+		size -= sizeof(uint32_t);
+	}
+	while (size--) *(buffer++) = (uint8_t) nextRandom();
+}
+
+static void putValue(uint8_t *buffer, size_t offset, uint32_t value, bool bigEndian)
+{
+
+	if (bigEndian)
+	{
+		buffer[offset] = value >> 24;
+		buffer[offset + 1] = value >> 16;
+		buffer[offset + 2] = value >> 8;
+		buffer[offset + 3] = value;
+	}
+	else
+	{
+		buffer[offset] = value;
+		buffer[offset + 1] = value >> 8;
+		buffer[offset + 2] = value >> 16;
+		buffer[offset + 3] = value >> 24;
+	}
+}
+
+static void buildDeviceTree(uint8_t *dtb, uint32_t size)
+{
+	uint32_t			propertySize = size - 40 - 16 - 28 - 8;
+	uint32_t			structOffset = 40 + 16;
+	uint32_t			structSize = 28 + propertySize;
+	uint32_t			stringsOffset = structOffset + structSize;
+
+	// header, memory reservation map, one node with one property, strings block with the property name
+	memset(dtb, 0, size);
+	putValue(dtb, 0, 0xD00DFEED, true);
+	putValue(dtb, 4, size, true);
+	putValue(dtb, 8, structOffset, true);
+	putValue(dtb, 12, stringsOffset, true);
+	putValue(dtb, 16, 40, true);
+	putValue(dtb, 20, 17, true);
+	putValue(dtb, 24, 16, true);
+	putValue(dtb, 28, 0, true);
+	putValue(dtb, 32, 8, true);
+	putValue(dtb, 36, structSize, true);
+	putValue(dtb, structOffset, 1, true);
+	putValue(dtb, structOffset + 8, 3, true);
+	putValue(dtb, structOffset + 12, propertySize, true);
+	putValue(dtb, structOffset + 16, 0, true);
+	fillRandom(dtb + structOffset + 20, propertySize);
+	putValue(dtb, structOffset + 20 + propertySize, 2, true);
+	putValue(dtb, structOffset + 24 + propertySize, 9, true);
+	memcpy(dtb + stringsOffset, "data", 5);
+}
+
+static uint32_t buildConfigArea(uint8_t *area, bool bigEndian, unsigned int deviceTrees, unsigned int modules)
+{
+	uint32_t			entry = AREA_ENTRIES;
+	uint32_t			dtbSize = ((AREA_NAMES - AREA_DEVICE_TREES) / deviceTrees) & ~15;
+	uint32_t			nameOffset = AREA_NAMES;
+	char				version[192];
+
+	if (dtbSize > 8192) dtbSize = 8192;
+
+	memset(area, 0, AREA_SIZE);
+	putValue(area, 0, AREA_BASE + AREA_ENTRIES, bigEndian);
+
+	putValue(area, entry, avm_kernel_config_tags_module_memory, bigEndian);
+	putValue(area, entry + 4, AREA_BASE + AREA_MODULES, bigEndian);
+	entry += 8;
+	putValue(area, entry, avm_kernel_config_tags_version_info, bigEndian);
+	putValue(area, entry + 4, AREA_BASE + AREA_VERSION_INFO, bigEndian);
+	entry += 8;
+
+	for (unsigned int i = 0; i < deviceTrees; i++)
+	{
+		putValue(area, entry, avm_kernel_config_tags_device_tree_subrev_0 + i, bigEndian);
+		putValue(area, entry + 4, AREA_BASE + AREA_DEVICE_TREES + i * dtbSize, bigEndian);
+		buildDeviceTree(area + AREA_DEVICE_TREES + i * dtbSize, dtbSize);
+		entry += 8;
+	}
+
+	// end of array marker
+	putValue(area, entry, avm_kernel_config_tags_last, bigEndian);
+
+	memset(version, 0, sizeof(version));
+	strcpy(version, "12345");
+	strcpy(version + 32, "67890");
+	strcpy(version + 64, "07.29 Benchmark");
+	memcpy(area + AREA_VERSION_INFO, version, sizeof(version));
+
+	for (unsigned int i = 0; i < modules; i++)
+	{
+		char			name[16];
+		size_t			nameSize = sprintf(name, "module%u", i) + 1;
+
+		memcpy(area + nameOffset, name, nameSize);
+		putValue(area, AREA_MODULES + i * 16, AREA_BASE + nameOffset, bigEndian);
+		putValue(area, AREA_MODULES + i * 16 + 4, 100000 + i, bigEndian);
+		putValue(area, AREA_MODULES + i * 16 + 8, 20000 + i, bigEndian);
+		putValue(area, AREA_MODULES + i * 16 + 12, 3000 + i, bigEndian);
+		nameOffset = (nameOffset + nameSize + 3) & ~3;
+	}
+
+	return dtbSize;
+}
+
+//	measurement
+
+static double now(void)
+{
+	struct timespec		ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *stage, double seconds, size_t bytes, unsigned int entries, unsigned int loops)
+{
+	double				perLoop = seconds / loops;
+
+	if (entries)
+		fprintf(stdout, "%-24s %12.3f %12.1f %12.1f\n", stage, perLoop * 1e6, bytes / perLoop / (1024 * 1024), perLoop * 1e9 / entries);
+	else
+		fprintf(stdout, "%-24s %12.3f %12.1f %12s\n", stage, perLoop * 1e6, bytes / perLoop / (1024 * 1024), "-");
+}
+
+int main(int argc, char * argv[])
+{
+	size_t					kernelSize = 32;
+	bool					bigEndian = true;
+	unsigned int			deviceTrees = 4;
+	unsigned int			modules = 64;
+	unsigned int			rounds = 5;
+	uint8_t *				kernel;
+	uint8_t *				area;
+	uint32_t				dtbSize;
+	unsigned int			entries;
+	unsigned int			matches;
+	int						devNull;
+	int						i = 1;
+
+	/* no reason to use a getopt implementation for our simple calling convention */
+	while (i < argc && *argv[i] == '-')
+	{
+		if (i + 1 >= argc)
+		{
+			usage();
+			exit(1);
+		}
+		if (strcmp(argv[i], "-s") == 0) kernelSize = strtoul(argv[i + 1], NULL, 10);
+		else if (strcmp(argv[i], "-e") == 0)
+		{
+			if (strcmp(argv[i + 1], "BE") == 0) bigEndian = true;
+			else if (strcmp(argv[i + 1], "LE") == 0) bigEndian = false;
+			else kernelSize = 0;
+		}
+		else if (strcmp(argv[i], "-d") == 0) deviceTrees = strtoul(argv[i + 1], NULL, 10);
+		else if (strcmp(argv[i], "-m") == 0) modules = strtoul(argv[i + 1], NULL, 10);
+		else if (strcmp(argv[i], "-r") == 0) rounds = strtoul(argv[i + 1], NULL, 10);
+		else kernelSize = 0;
+		i += 2;
+	}
+
+	if (i < argc || kernelSize == 0 || rounds == 0 || deviceTrees == 0 || modules > MAX_MODULES ||
+		deviceTrees > (unsigned int) (avm_kernel_config_tags_device_tree_subrev_last - avm_kernel_config_tags_device_tree_subrev_0 + 1))
+	{
+		usage();
+		exit(1);
+	}
+
+	kernelSize *= 1024 * 1024;
+	if (kernelSize < 2 * AREA_SIZE) kernelSize = 2 * AREA_SIZE;
+
+	// the config area is located relative to 4K boundaries of the buffer address, like in a mapped file
+	if ((errno = posix_memalign((void **) &kernel, 4096, kernelSize)) != 0)
+	{
+		fprintf(stderr, "Error %d allocating memory for the kernel image.\n", errno);
+		exit(1);
+	}
+	if ((devNull = open("/dev/null", O_WRONLY)) == -1)
+	{
+		fprintf(stderr, "Error %d opening /dev/null.\n", errno);
+		exit(1);
+	}
+
+	// the area is placed near the end of the image, so the searches have to look at most of its content
+	fillRandom(kernel, kernelSize);
+	area = kernel + (((kernelSize / 4) * 3) & ~4095);
+	dtbSize = buildConfigArea(area, bigEndian, deviceTrees, modules);
+	entries = deviceTrees + 2 + modules;
+
+	fprintf(stdout, "kernel size: %zu MB, endianess: %s, device trees: %u (%u bytes each), modules: %u, rounds: %u\n\n",
+		kernelSize / (1024 * 1024), (bigEndian ? "BE" : "LE"), deviceTrees, dtbSize, modules, rounds);
+	fprintf(stdout, "%-24s %12s %12s %12s\n", "stage", "time (us)", "MB/s", "ns/entry");
+
+	// FDT signature scan
+	{
+		double					best = 0;
+
+		for (unsigned int round = 0; round < rounds; round++)
+		{
+			double				start = now();
+
+			if (locateConfigArea(kernel, kernelSize, NULL, AREA_SIZE, &matches) != area)
+			{
+				fprintf(stderr, "The signature scan didn't find the config area.\n");
+				exit(1);
+			}
+			start = now() - start;
+			if (round == 0 || start < best) best = start;
+		}
+		report("signature scan", best, kernelSize, 0, 1);
+	}
+
+	// DTB search with a prepared needle
+	{
+		struct deviceTreeSearch	search;
+		double					best = 0;
+
+		if (!prepareDeviceTreeSearch(&search, area + AREA_DEVICE_TREES, dtbSize)) exit(1);
+		for (unsigned int round = 0; round < rounds; round++)
+		{
+			double				start = now();
+
+			if (locateConfigArea(kernel, kernelSize, &search, AREA_SIZE, &matches) != area)
+			{
+				fprintf(stderr, "The DTB search didn't find the config area.\n");
+				exit(1);
+			}
+			start = now() - start;
+			if (round == 0 || start < best) best = start;
+		}
+		releaseDeviceTreeSearch(&search);
+		report("dtb search", best, kernelSize, 0, 1);
+	}
+
+	// the other stages are too fast for a single call, each round repeats them
+	{
+		unsigned int			loops = 1000;
+		double					best = 0;
+		bool					swapNeeded;
+
+		for (unsigned int round = 0; round < rounds; round++)
+		{
+			double				start = now();
+
+			for (unsigned int loop = 0; loop < loops; loop++)
+			{
+				if (!detectInputEndianess(area, AREA_SIZE, &swapNeeded))
+				{
+					fprintf(stderr, "The endianess detection failed.\n");
+					exit(1);
+				}
+			}
+			start = now() - start;
+			if (round == 0 || start < best) best = start;
+		}
+		report("endianess detection", best, AREA_SIZE, entries, loops);
+
+		for (unsigned int round = 0; round < rounds; round++)
+		{
+			double				start = now();
+
+			for (unsigned int loop = 0; loop < loops; loop++)
+			{
+				struct configAreaView	view;
+				struct configAreaModule	module;
+				unsigned int			number = 0;
+
+				if (!openConfigAreaView(&view, area, AREA_SIZE))
+				{
+					fprintf(stderr, "The config area couldn't be indexed.\n");
+					exit(1);
+				}
+				while (getConfigAreaModule(&view, number, &module)) number++;
+				if (number != modules)
+				{
+					fprintf(stderr, "The module memory table contains %u entries instead of %u.\n", number, modules);
+					exit(1);
+				}
+			}
+			start = now() - start;
+			if (round == 0 || start < best) best = start;
+		}
+		report("index and relocation", best, AREA_SIZE, entries, loops);
+
+		loops = 20;
+		for (unsigned int round = 0; round < rounds; round++)
+		{
+			struct configAreaView	view;
+			double					start;
+
+			openConfigAreaView(&view, area, AREA_SIZE);
+			start = now();
+			for (unsigned int loop = 0; loop < loops; loop++)
+			{
+				if (writeConfigAreaSource(&view, devNull, NULL) != 0) exit(1);
+			}
+			start = now() - start;
+			if (round == 0 || start < best) best = start;
+		}
+		report("emission", best, AREA_SIZE, entries, loops);
+	}
+
+	close(devNull);
+	free(kernel);
+
+	exit(0);
+}
@@ -0,0 +1,351 @@
+// vim: set tabstop=4 syntax=c :
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/***********************************************************************
+ *                                                                     *
+ *                                                                     *
+ * Copyright (C) 2016-2021 P.Hämmerlein (http://www.yourfritz.de)      *
+ *                                                                     *
+ * This program is free software; you can redistribute it and/or       *
+ * modify it under the terms of the GNU General Public License         *
+ * as published by the Free Software Foundation; either version 2      *
+ * of the License, or (at your option) any later version.              *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program, please look for the file COPYING.          *
+ *                                                                     *
+ ***********************************************************************/
+
+#define _DEFAULT_SOURCE
+#define _FILE_OFFSET_BITS 64
+#include "avm_kernel_config_helpers.h"
+
+#define SYMBOL_PREFIX			"__avm_kernel_config_"
+#define SYMBOLS_FILE			"/proc/kallsyms"
+#define MEMORY_FILE				"/dev/mem"
+#define AREA_ALIGNMENT			4096
+#define PHYSICAL_ADDRESS_MASK	0x1FFFFFFF
+#define READ_BUFFER_SIZE		(64 * 1024)
+
+void usage()
+{
+
+	fprintf(stderr, "dump_avm_kernel_config - dump the kernel config area from a running system\n\n");
+	fprintf(stderr, "(C) 2016-2021 P. Hämmerlein (http://www.yourfritz.de)\n\n");
+	fprintf(stderr, "Licensed under GPLv2, see LICENSE file from source repository.\n\n");
+	fprintf(stderr, "Usage:\n\n");
+	fprintf(stderr, "dump_avm_kernel_config [ -k <symbols_file> ] [ -m <memory_file> ] [ -g [ -o <output_file> [ -i ] ] ]\n");
+	fprintf(stderr, "\nThe addresses of the symbols '" SYMBOL_PREFIX "start' and '" SYMBOL_PREFIX "end'");
+	fprintf(stderr, "\nare read from " SYMBOLS_FILE " (or the file specified with -k) and the");
+	fprintf(stderr, "\ncontent of the area between them is read from " MEMORY_FILE " (or the file");
+	fprintf(stderr, "\nspecified with -m) at the physical address of the area.\n");
+	fprintf(stderr, "\nThe binary dump is written to STDOUT, so you've to redirect it to any");
+	fprintf(stderr, "\nlocation. If the -g option is used, the assembler source for the area");
+	fprintf(stderr, "\nis generated instead - the options -o and -i have the same meaning as");
+	fprintf(stderr, "\nfor 'gen_avm_kernel_config' then.\n");
+
+}
+
+//	symbol lookup
+//
+//	- the symbols file is read with large blocks and each line is parsed in the buffer, there's no need to split
+//	  the file into lines first
+//	- the lookup stops, as soon as both symbols were found - usually they're located near the start of the file
+//	- lines look like '<address> <type> <name>[\t<module>]', the address has 8 or 16 hexadecimal digits
+
+static bool parseSymbolLine(const char *line, size_t length, uint64_t *address, const char * *name, size_t *nameLength)
+{
+	const char *		end = line + length;
+	const char *		ptr = line;
+	uint64_t			value = 0;
+
+	while (ptr < end && *ptr != ' ')
+	{
+		char			c = *(ptr++);
+
+		if (c >= '0' && c <= '9') value = (value << 4) | (c - '0');
+		else if (c >= 'a' && c <= 'f') value = (value << 4) | (c - 'a' + 10);
+		else if (c >= 'A' && c <= 'F') value = (value << 4) | (c - 'A' + 10);
+		else return false;
+	}
+
+	// skip the separator, the type and the next separator
+	if (ptr == line || end - ptr < 3 || *(ptr + 2) != ' ') return false;
+	ptr += 3;
+
+	*address = value;
+	*name = ptr;
+	while (ptr < end && *ptr != '\t' && *ptr != ' ') ptr++;
+	*nameLength = ptr - *name;
+
+	return true;
+}
+
+bool lookupAreaSymbols(const char *fileName, uint64_t *start, uint64_t *end)
+{
+	const char *		prefix = SYMBOL_PREFIX;
+	size_t				prefixLength = strlen(prefix);
+	char *				buffer;
+	size_t				used = 0;
+	bool				foundStart = false;
+	bool				foundEnd = false;
+	bool				eof = false;
+	int					fd;
+
+	if ((fd = open(fileName, O_RDONLY)) == -1)
+	{
+		fprintf(stderr, "Error %d opening symbols file '%s'.\n", errno, fileName);
+		return false;
+	}
+
+	if ((buffer = malloc(READ_BUFFER_SIZE)) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the symbols buffer.\n", errno);
+		close(fd);
+		return false;
+	}
+
+	while (!(foundStart && foundEnd) && !eof)
+	{
+		ssize_t			count = read(fd, buffer + used, READ_BUFFER_SIZE - used);
+		char *			line = buffer;
+		char *			newLine;
+
+		if (count == -1)
+		{
+			if (errno == EINTR) continue;
+			fprintf(stderr, "Error %d reading symbols file '%s'.\n", errno, fileName);
+			break;
+		}
+		if (count == 0)
+		{
+			// a last line without a newline character is processed, too
+			eof = true;
+			if (used == 0) break;
+			buffer[used++] = '\n';
+		}
+		else used += count;
+
+		while ((newLine = memchr(line, '\n', used - (line - buffer))) != NULL)
+		{
+			uint64_t		address;
+			const char *	name;
+			size_t			nameLength;
+
+			if (parseSymbolLine(line, newLine - line, &address, &name, &nameLength) && nameLength > prefixLength && memcmp(name, prefix, prefixLength) == 0)
+			{
+				name += prefixLength;
+				nameLength -= prefixLength;
+
+				if (nameLength == 5 && memcmp(name, "start", 5) == 0)
+				{
+					*start = address;
+					foundStart = true;
+				}
+				else if (nameLength == 3 && memcmp(name, "end", 3) == 0)
+				{
+					*end = address;
+					foundEnd = true;
+				}
+			}
+			line = newLine + 1;
+		}
+
+		// keep the incomplete line for the next read, a line longer than the whole buffer is dropped
+		used -= line - buffer;
+		if (used == READ_BUFFER_SIZE) used = 0;
+		else if (used > 0) memmove(buffer, line, used);
+	}
+
+	free(buffer);
+	close(fd);
+
+	if (!foundStart) fprintf(stderr, "Unable to locate %sstart symbol.\n", prefix);
+	if (!foundEnd) fprintf(stderr, "Unable to locate %send symbol.\n", prefix);
+
+	return (foundStart && foundEnd);
+}
+
+//	memory access
+//
+//	- the area is read with a single 'pread' call from the physical address, which is the kernel address without the
+//	  segment bits (KSEG0 on MIPS)
+
+void * readConfigArea(const char *fileName, uint64_t start, size_t size)
+{
+	void *				area;
+	int					fd;
+	size_t				done = 0;
+
+	if ((area = malloc(size)) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the config area.\n", errno);
+		return NULL;
+	}
+
+	if ((fd = open(fileName, O_RDONLY | O_SYNC)) == -1)
+	{
+		fprintf(stderr, "Error %d opening memory file '%s'.\n", errno, fileName);
+		free(area);
+		return NULL;
+	}
+
+	while (done < size)
+	{
+		ssize_t			count = pread(fd, (uint8_t *) area + done, size - done, (off_t) ((start & PHYSICAL_ADDRESS_MASK) + done));
+
+		if (count == -1 && errno == EINTR) continue;
+		if (count <= 0)
+		{
+			fprintf(stderr, "Error %d copying memory content from %s.\n", (count == 0 ? EIO : errno), fileName);
+			free(area);
+			area = NULL;
+			break;
+		}
+		done += count;
+	}
+
+	close(fd);
+
+	return area;
+}
+
+int main(int argc, char * argv[])
+{
+	int						returnCode = 1;
+	const char *			symbolsFile = SYMBOLS_FILE;
+	const char *			memoryFile = MEMORY_FILE;
+	char *					outputName = NULL;
+	char *					incbinPrefix = NULL;
+	bool					generate = false;
+	bool					incbin = false;
+	uint64_t				start = 0;
+	uint64_t				end = 0;
+	void *					area;
+	int						i = 1;
+
+	/* no reason to use a getopt implementation for our simple calling convention */
+	while (i < argc && *argv[i] == '-')
+	{
+		if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+		{
+			symbolsFile = argv[i + 1];
+			i += 2;
+		}
+		else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+		{
+			memoryFile = argv[i + 1];
+			i += 2;
+		}
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+		{
+			outputName = argv[i + 1];
+			i += 2;
+		}
+		else if (strcmp(argv[i], "-g") == 0)
+		{
+			generate = true;
+			i += 1;
+		}
+		else if (strcmp(argv[i], "-i") == 0)
+		{
+			incbin = true;
+			i += 1;
+		}
+		else break;
+	}
+
+	if (i < argc || (outputName != NULL && !generate) || (incbin && outputName == NULL))
+	{
+		usage();
+		exit(1);
+	}
+
+	if (outputName == NULL && isatty(1))
+	{
+		fprintf(stderr, "%s will be written to STDOUT, please redirect it to any location.\n", (generate ? "Assembler source" : "Memory dump"));
+		exit(1);
+	}
+
+	if (!lookupAreaSymbols(symbolsFile, &start, &end)) exit(1);
+
+	if (start % AREA_ALIGNMENT)
+	{
+		fprintf(stderr, "Unexpected alignment of symbol %sstart.\n", SYMBOL_PREFIX);
+		exit(1);
+	}
+	if (end % AREA_ALIGNMENT)
+	{
+		fprintf(stderr, "Unexpected alignment of symbol %send.\n", SYMBOL_PREFIX);
+		exit(1);
+	}
+	if (end <= start)
+	{
+		fprintf(stderr, "Computed config area size is invalid.\n");
+		exit(1);
+	}
+
+	if ((area = readConfigArea(memoryFile, start, end - start)) == NULL) exit(1);
+
+	if (generate)
+	{
+		struct configAreaView	view;
+		int						outputFile = 1;
+
+		if (incbin)
+		{
+			char *				suffix;
+
+			// the DTB files get the name of the output file without its suffix
+			if ((incbinPrefix = malloc(strlen(outputName) + 1)) == NULL)
+			{
+				fprintf(stderr, "Error %d allocating memory for a file name.\n", errno);
+				exit(1);
+			}
+			strcpy(incbinPrefix, outputName);
+			if ((suffix = strrchr(incbinPrefix, '.')) != NULL && strchr(suffix, '/') == NULL) *suffix = 0;
+		}
+
+		if (!openConfigAreaView(&view, area, end - start))
+		{
+			fprintf(stderr, "Unable to identify and relocate the dumped config area, may be it's empty.\n");
+		}
+		else if (outputName != NULL && (outputFile = open(outputName, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+		{
+			fprintf(stderr, "Error %d creating output file '%s'.\n", errno, outputName);
+		}
+		else
+		{
+			returnCode = writeConfigAreaSource(&view, outputFile, incbinPrefix);
+			if (outputName != NULL) close(outputFile);
+		}
+
+		free(incbinPrefix);
+	}
+	else
+	{
+		size_t				done = 0;
+
+		while (done < end - start)
+		{
+			ssize_t			written = write(1, (uint8_t *) area + done, (end - start) - done);
+
+			if (written == -1 && errno == EINTR) continue;
+			if (written <= 0)
+			{
+				fprintf(stderr, "Error %d writing memory dump.\n", errno);
+				break;
+			}
+			done += written;
+		}
+		if (done == end - start) returnCode = 0;
+	}
+
+	free(area);
+
+	exit(returnCode);
+}
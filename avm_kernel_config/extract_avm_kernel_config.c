@@ -22,6 +22,8 @@
 
 #include "avm_kernel_config_helpers.h"
 #include <libfdt.h>
+#include <pthread.h>
+#include <dirent.h>
 
 void usage()
 {
@@ -29,7 +31,8 @@ void usage()
 	fprintf(stderr, "(C) 2016-2021 P. Hämmerlein (http://www.yourfritz.de)\n\n");
 	fprintf(stderr, "Licensed under GPLv2, see LICENSE file from source repository.\n\n");
 	fprintf(stderr, "Usage:\n\n");
-	fprintf(stderr, "extract_avm_kernel_config [ -s <size in KByte> ] <unpacked_kernel> [<dtb_file>]\n");
+	fprintf(stderr, "extract_avm_kernel_config [ -s <size in KByte> ] [ -a ] [ -u ] <unpacked_kernel> [<dtb_file>]\n");
+	fprintf(stderr, "extract_avm_kernel_config [ -s <size in KByte> ] [ -u ] -b <list_file|directory> [ -o <output_dir> ] [ -j <workers> ] [<dtb_file>]\n");
 	fprintf(stderr, "\nThe specified DTB content (a compiled OF device tree BLOB) is");
 	fprintf(stderr, "\nsearched in the unpacked kernel and the place, where it's found");
 	fprintf(stderr, "\nis assumed to be within the original kernel config area.\n");
@@ -41,138 +44,448 @@ void usage()
 	fprintf(stderr, "\nTo support different models with changing sizes of the embedded");
 	fprintf(stderr, "\nconfiguration area, a default size of 64 KB for this area is used,");
 	fprintf(stderr, "\nwhich may be overwritten with the -s option.\n");
+	fprintf(stderr, "\nThe -a (or --all) option lists each location, where the DTB (or");
+	fprintf(stderr, "\nthe FDT signature) was found, together with the offset of the");
+	fprintf(stderr, "\nconfig area around it (or '-', if the checks have failed). No");
+	fprintf(stderr, "\ncontent is extracted in this mode.\n");
+	fprintf(stderr, "\nThe -u (or --unpack) option accepts a packed (LZMA compressed) MIPS");
+	fprintf(stderr, "\nkernel image (e.g. a copy of the kernel partition) instead of an");
+	fprintf(stderr, "\nunpacked one, it's decompressed in memory prior to the search.");
+	fprintf(stderr, "\nIf no DTB file was specified, the image is scanned while it's");
+	fprintf(stderr, "\ndecompressed and decompression stops, if the area was found. The");
+	fprintf(stderr, "\nimage may be read from STDIN in this case, use '-' as file name.\n");
+	fprintf(stderr, "\nThe -b (or --batch) option processes many kernels at once. The");
+	fprintf(stderr, "\nkernel files are read from the specified list file (one name per");
+	fprintf(stderr, "\nline) or they're collected from the specified directory and its");
+	fprintf(stderr, "\nsubdirectories. They're processed with a pool of worker threads");
+	fprintf(stderr, "\n(one per CPU, if not specified with -j) and the config area of each");
+	fprintf(stderr, "\nkernel is written to a file with the suffix '.area' in the output");
+	fprintf(stderr, "\ndirectory (specified with -o, the current directory is the default).");
+	fprintf(stderr, "\nThe file 'index' in the output directory contains a line per kernel");
+	fprintf(stderr, "\nwith tab separated values: the kernel file name, the area file name,");
+	fprintf(stderr, "\nthe area offset in the kernel, the area size, the endianess of the");
+	fprintf(stderr, "\ntarget, the list of device tree subrevisions and the result.");
+	fprintf(stderr, "\nThe -a (or --all) option can't be used in this mode.\n");
 }
 
-bool checkConfigArea(struct _avm_kernel_config ** configArea, size_t configSize)
+//	batch processing
+//
+//	- the list of kernel files is built first, then a pool of worker threads takes the next file from this list,
+//	  until all files were processed
+//	- each worker writes the area file for its kernel, the index is written after all workers have finished, so the
+//	  order of its lines is the same as the order of the input files
+
+struct batchJob
+{
+	char *						fileName;
+	char *						areaName;
+	bool						success;
+	const char *				result;
+	size_t						areaOffset;
+	bool						bigEndian;
+	unsigned int				subRevisions;
+};
+
+struct batchQueue
 {
-	bool			swapNeeded = false;
+	struct batchJob *			jobs;
+	size_t						count;
+	size_t						allocated;
+	size_t						next;
+	struct deviceTreeSearch *	search;
+	size_t						size;
+	const char *				outputDirectory;
+	bool						unpack;
+};
+
+bool addBatchJob(struct batchQueue *queue, const char *fileName, const char *relativeName)
+{
+	struct batchJob *			job;
+	char *						name;
+
+	if (queue->count == queue->allocated)
+	{
+		size_t					allocated = (queue->allocated == 0 ? 256 : queue->allocated * 2);
+		struct batchJob *		jobs = realloc(queue->jobs, allocated * sizeof(struct batchJob));
+
+		if (jobs == NULL)
+		{
+			fprintf(stderr, "Error %d allocating memory for the list of kernel files.\n", errno);
+			return false;
+		}
+		queue->jobs = jobs;
+		queue->allocated = allocated;
+	}
+
+	job = &queue->jobs[queue->count];
+	memset(job, 0, sizeof(struct batchJob));
+
+	// the area file name is built from the relative path of the kernel file, with slashes replaced by underscores
+	while (*relativeName == '/' || (*relativeName == '.' && *(relativeName + 1) == '/')) relativeName += (*relativeName == '/' ? 1 : 2);
+
+	if ((job->fileName = malloc(strlen(fileName) + 1)) == NULL || (job->areaName = malloc(strlen(relativeName) + 6)) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the list of kernel files.\n", errno);
+		free(job->fileName);
+		return false;
+	}
+
+	strcpy(job->fileName, fileName);
+	for (name = job->areaName; *relativeName; relativeName++) *(name++) = (*relativeName == '/' ? '_' : *relativeName);
+	strcpy(name, ".area");
 
-	if (!detectInputEndianess(configArea, configSize, &swapNeeded)) return false;
+	queue->count++;
 	return true;
 }
 
-struct _avm_kernel_config ** findConfigArea(void *dtbLocation, size_t size)
+bool collectBatchDirectory(struct batchQueue *queue, const char *directory, size_t prefixLength)
 {
-	struct _avm_kernel_config **	configArea = NULL;
+	DIR *						dir;
+	struct dirent *				dirEntry;
+	bool						result = true;
 
-	// previous 4K boundary should be the start of the config area
-	configArea = (struct _avm_kernel_config **) (((int) dtbLocation >> 12) << 12);
+	if ((dir = opendir(directory)) == NULL)
+	{
+		fprintf(stderr, "Error %d opening directory '%s'.\n", errno, directory);
+		return false;
+	}
 
-	if (checkConfigArea(configArea, size)) return configArea;
+	while (result && (dirEntry = readdir(dir)) != NULL)
+	{
+		char *					path;
+		struct stat				entryStat;
+
+		if (strcmp(dirEntry->d_name, ".") == 0 || strcmp(dirEntry->d_name, "..") == 0) continue;
+
+		if ((path = malloc(strlen(directory) + strlen(dirEntry->d_name) + 2)) == NULL)
+		{
+			fprintf(stderr, "Error %d allocating memory for the list of kernel files.\n", errno);
+			result = false;
+			break;
+		}
+		sprintf(path, "%s/%s", directory, dirEntry->d_name);
+
+		if (stat(path, &entryStat) == 0)
+		{
+			if (S_ISDIR(entryStat.st_mode)) result = collectBatchDirectory(queue, path, prefixLength);
+			else if (S_ISREG(entryStat.st_mode)) result = addBatchJob(queue, path, path + prefixLength);
+		}
+		else fprintf(stderr, "Error %d getting file stats for '%s'.\n", errno, path);
+
+		free(path);
+	}
+
+	closedir(dir);
+	return result;
+}
+
+bool collectBatchList(struct batchQueue *queue, const char *listName)
+{
+	FILE *						list;
+	char						line[4096];
+	bool						result = true;
+
+	if ((list = fopen(listName, "r")) == NULL)
+	{
+		fprintf(stderr, "Error %d opening list file '%s'.\n", errno, listName);
+		return false;
+	}
+
+	while (result && fgets(line, sizeof(line), list) != NULL)
+	{
+		size_t					length = strcspn(line, "\r\n");
+
+		line[length] = 0;
+		if (length == 0 || *line == '#') continue;
+		result = addBatchJob(queue, line, line);
+	}
+
+	fclose(list);
+	return result;
+}
+
+int compareBatchJobs(const void *left, const void *right)
+{
+
+	return strcmp(((struct batchJob *) left)->fileName, ((struct batchJob *) right)->fileName);
+
+}
+
+int compareAreaNames(const void *left, const void *right)
+{
+	const struct batchJob *		leftJob = *((const struct batchJob **) left);
+	const struct batchJob *		rightJob = *((const struct batchJob **) right);
+	int							result = strcmp(leftJob->areaName, rightJob->areaName);
+
+	// the job with the first file name keeps the name
+	if (result == 0) result = (leftJob < rightJob ? -1 : (leftJob > rightJob ? 1 : 0));
+	return result;
+}
+
+int compareAreaName(const void *key, const void *element)
+{
+
+	return strcmp((const char *) key, (*((const struct batchJob **) element))->areaName);
 
-	return NULL;
 }
 
-void * findDeviceTreeImage(void *haystack, size_t haystackSize, void *needle, size_t needleSize)
+//	different paths may be mapped to the same area file name (e.g. 'a/b_c' and 'a_b/c') and a list may contain a
+//	kernel file twice - each following job gets a sequence number ('<name>.<n>.area') then, which isn't used yet
+
+bool uniqueAreaNames(struct batchQueue *queue)
 {
-	void *		location = NULL;
-	size_t		toSearch = haystackSize / sizeof(uint32_t);
-	size_t		offsetMatched = 0;
-	bool		matchedSoFar = false;
-	uint32_t *	resetSliding;
-	size_t		resetToSearch;
-
-	if (toSearch > 0)
+	struct batchJob **			sorted;
+	char **						names;
+	size_t						i;
+	size_t						first = 0;
+	unsigned int				sequence = 1;
+	bool						result = true;
+
+	sorted = malloc(queue->count * sizeof(struct batchJob *));
+	names = calloc(queue->count, sizeof(char *));
+	if (sorted == NULL || names == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the list of kernel files.\n", errno);
+		free(sorted);
+		free(names);
+		return false;
+	}
+
+	for (i = 0; i < queue->count; i++) sorted[i] = &queue->jobs[i];
+	qsort(sorted, queue->count, sizeof(struct batchJob *), compareAreaNames);
+
+	for (i = 1; result && i < queue->count; i++)
 	{
-		uint32_t *	sliding = haystack;
-		uint32_t *	lookFor = needle;
+		size_t					baseLength;
+		char *					name;
 
-		while (toSearch > 0)
+		if (strcmp(sorted[i]->areaName, sorted[first]->areaName) != 0)
 		{
-			while (*sliding != *lookFor)
-			{
-				toSearch--;
-				sliding++;
-				if (toSearch == 0) break;
-			}
+			first = i;
+			sequence = 1;
+			continue;
+		}
 
-			if (toSearch > 0) // match found for first uint32
-			{
-				matchedSoFar = true;
-				resetToSearch = --toSearch;
-				resetSliding = ++sliding;
-				offsetMatched = sizeof(uint32_t);
+		baseLength = strlen(sorted[i]->areaName) - 5;
+		if ((name = malloc(baseLength + 16)) == NULL)
+		{
+			fprintf(stderr, "Error %d allocating memory for the list of kernel files.\n", errno);
+			result = false;
+			break;
+		}
 
-				if ((needleSize - offsetMatched) > sizeof(uint32_t))
-				{
-					while (offsetMatched < needleSize)
-					{
-						if (*(lookFor + (offsetMatched / sizeof(uint32_t))) != *sliding) // difference found, reset match
-						{
-							matchedSoFar = false;
-							sliding = resetSliding;
-							toSearch = resetToSearch;
-							break;
-						}
-
-						offsetMatched += sizeof(uint32_t);
-						sliding++;
-						toSearch--;
-
-						if (toSearch == 0) break; // end of kernel reached, DTB isn't expected at the very end
-						if ((needleSize - offsetMatched) < sizeof(uint32_t)) break;
-					}
-				}
+		// the sequence numbers of a group are ascending, so only the original names have to be checked
+		do
+		{
+			sprintf(name, "%.*s.%u.area", (int) baseLength, sorted[i]->areaName, ++sequence);
+		}
+		while (bsearch(name, sorted, queue->count, sizeof(struct batchJob *), compareAreaName) != NULL);
+
+		fprintf(stderr, "The area file for '%s' is named '%s', '%s' is used for '%s' already.\n", sorted[i]->fileName, name,
+			sorted[first]->areaName, sorted[first]->fileName);
+		names[i] = name;
+	}
+
+	// the sorted list is needed to check the new names, so they're set afterwards
+	for (i = 0; i < queue->count; i++)
+	{
+		if (names[i] == NULL) continue;
+		free(sorted[i]->areaName);
+		sorted[i]->areaName = names[i];
+	}
+
+	free(names);
+	free(sorted);
+	return result;
+}
+
+void processBatchJob(struct batchQueue *queue, struct batchJob *job)
+{
+	struct memoryMappedFile			kernel;
+	void *							configArea;
+	unsigned int					matches;
+	struct configAreaIndex			index;
 
-				if (matchedSoFar) // compare remaining bytes
+	job->result = "error";
+
+	if (!openKernelImage(&kernel, job->fileName, queue->unpack)) return;
+
+	if ((configArea = locateConfigArea(kernel.fileBuffer, kernel.fileStat.st_size, queue->search, queue->size, &matches)) != NULL)
+	{
+		char *						areaPath = malloc(strlen(queue->outputDirectory) + strlen(job->areaName) + 2);
+		int							areaFile;
+
+		indexConfigArea(configArea, queue->size, &index);
+
+		job->areaOffset = configArea - kernel.fileBuffer;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		job->bigEndian = index.swapNeeded;
+#else
+		job->bigEndian = !index.swapNeeded;
+#endif
+		job->subRevisions = index.subRevisions;
+
+		if (areaPath != NULL)
+		{
+			sprintf(areaPath, "%s/%s", queue->outputDirectory, job->areaName);
+
+			if ((areaFile = open(areaPath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) != -1)
+			{
+				if (write(areaFile, configArea, queue->size) == (ssize_t) queue->size)
 				{
-					uint8_t *	remHaystack = (uint8_t *) sliding;
-					uint8_t *	remNeedle = (uint8_t *) (needle + offsetMatched);
-					size_t		remSize = needleSize - offsetMatched;
-
-					while (remSize > 0)
-					{
-						if (*remHaystack != *remNeedle) // difference found
-						{
-							matchedSoFar = false;
-							sliding = resetSliding;
-							toSearch = resetToSearch;
-							break;
-						}
-
-						remHaystack++;
-						remNeedle++;
-						remSize--;
-					}
-
-					if (remSize == 0) // match completed
-					{
-						location = (void *) --resetSliding;
-						break;
-					}
+					job->success = true;
+					job->result = "ok";
 				}
+				else fprintf(stderr, "Error %d writing config area file '%s'.\n", errno, areaPath);
+				close(areaFile);
 			}
+			else fprintf(stderr, "Error %d creating config area file '%s'.\n", errno, areaPath);
+
+			free(areaPath);
 		}
+		else fprintf(stderr, "Error %d allocating memory for the name of the area file.\n", errno);
+	}
+	else
+	{
+		job->result = (matches == 0 ? "not found" : "unexpected content");
 	}
 
-	return location;
+	closeMemoryMappedFile(&kernel);
 }
 
-void * locateDeviceTreeSignature(void *kernelBuffer, size_t kernelSize)
+void * batchWorker(void *arg)
 {
-	void *		location = NULL;
-	uint32_t	signature = 0xD00DFEED;
-	uint32_t *	ptr = (uint32_t *) kernelBuffer;
+	struct batchQueue *		queue = (struct batchQueue *) arg;
+	size_t					index;
 
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-	// the DTB signature is store in 'big endian' => swap needed, if we're running on 'little endian' machine
-	swapEndianess(true, &signature);
-#endif
+	while ((index = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED)) < queue->count)
+	{
+		processBatchJob(queue, &queue->jobs[index]);
+	}
+
+	return NULL;
+}
+
+bool writeBatchIndex(struct batchQueue *queue)
+{
+	char *					indexPath = malloc(strlen(queue->outputDirectory) + 7);
+	FILE *					index;
 
-	while ((void *) ptr < (kernelBuffer + kernelSize))
+	if (indexPath == NULL)
 	{
-		if (*ptr == signature) // possibly found the tree
+		fprintf(stderr, "Error %d allocating memory for the name of the index file.\n", errno);
+		return false;
+	}
+	sprintf(indexPath, "%s/index", queue->outputDirectory);
+
+	if ((index = fopen(indexPath, "w")) == NULL)
+	{
+		fprintf(stderr, "Error %d creating index file '%s'.\n", errno, indexPath);
+		free(indexPath);
+		return false;
+	}
+
+	fprintf(index, "# kernel\tarea\toffset\tsize\tendianess\tsubrevisions\tresult\n");
+
+	for (size_t i = 0; i < queue->count; i++)
+	{
+		struct batchJob *	job = &queue->jobs[i];
+
+		if (job->success)
 		{
-			if (fdt_check_header((void *) ptr) == 0)
+			fprintf(index, "%s\t%s\t0x%08zx\t%zu\t%s\t", job->fileName, job->areaName, job->areaOffset, queue->size, (job->bigEndian ? "BE" : "LE"));
+			if (job->subRevisions == 0) fprintf(index, "-");
+			for (int subRev = 0, first = 1; subRev <= avm_kernel_config_tags_device_tree_subrev_last - avm_kernel_config_tags_device_tree_subrev_0; subRev++)
 			{
-				location = ptr;
-				break;
+				if (!(job->subRevisions & (1 << subRev))) continue;
+				fprintf(index, "%s%u", (first ? "" : ","), subRev);
+				first = 0;
 			}
+			fprintf(index, "\t%s\n", job->result);
+		}
+		else
+		{
+			fprintf(index, "%s\t-\t-\t-\t-\t-\t%s\n", job->fileName, job->result);
 		}
-		ptr++;
 	}
 
-	return location;
+	fclose(index);
+	free(indexPath);
+	return true;
+}
+
+int processBatch(const char *source, const char *outputDirectory, unsigned int workers, struct deviceTreeSearch *search, size_t size, bool unpack)
+{
+	struct batchQueue		queue;
+	struct stat				sourceStat;
+	pthread_t *				threads;
+	unsigned int			started = 0;
+	int						returnCode = 0;
+	bool					collected;
+
+	memset(&queue, 0, sizeof(queue));
+	queue.search = search;
+	queue.size = size;
+	queue.outputDirectory = outputDirectory;
+	queue.unpack = unpack;
+
+	if (stat(source, &sourceStat) == -1)
+	{
+		fprintf(stderr, "Error %d getting file stats for '%s'.\n", errno, source);
+		return 1;
+	}
+
+	if (S_ISDIR(sourceStat.st_mode)) collected = collectBatchDirectory(&queue, source, strlen(source) + 1);
+	else collected = collectBatchList(&queue, source);
+
+	if (collected && queue.count == 0) fprintf(stderr, "No kernel files found to process.\n");
+	if (!collected || queue.count == 0) returnCode = 1;
+
+	if (returnCode == 0 && mkdir(outputDirectory, 0755) == -1 && errno != EEXIST)
+	{
+		fprintf(stderr, "Error %d creating output directory '%s'.\n", errno, outputDirectory);
+		returnCode = 1;
+	}
+
+	if (returnCode == 0)
+	{
+		qsort(queue.jobs, queue.count, sizeof(struct batchJob), compareBatchJobs);
+		if (!uniqueAreaNames(&queue)) returnCode = 1;
+	}
+
+	if (returnCode == 0)
+	{
+		if (workers > queue.count) workers = queue.count;
+
+		if ((threads = malloc(workers * sizeof(pthread_t))) != NULL)
+		{
+			for (started = 0; started < workers; started++)
+			{
+				if (pthread_create(&threads[started], NULL, batchWorker, &queue) != 0) break;
+			}
+			// if no thread could be started, the main thread has to do all the work
+			if (started == 0) batchWorker(&queue);
+			for (unsigned int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+			free(threads);
+		}
+		else batchWorker(&queue);
+
+		if (!writeBatchIndex(&queue)) returnCode = 1;
+
+		for (size_t i = 0; i < queue.count; i++)
+		{
+			if (!queue.jobs[i].success) returnCode = 1;
+		}
+	}
+
+	for (size_t i = 0; i < queue.count; i++)
+	{
+		free(queue.jobs[i].fileName);
+		free(queue.jobs[i].areaName);
+	}
+	free(queue.jobs);
+
+	return returnCode;
 }
 
 int main(int argc, char * argv[])
@@ -180,23 +493,59 @@ int main(int argc, char * argv[])
 	int						returnCode = 1;
 	struct memoryMappedFile	kernel;
 	struct memoryMappedFile	dtb;
-	void *					dtbLocation = NULL;
+	struct deviceTreeSearch	search;
+	bool					useSearch = false;
+	bool					listAll = false;
+	bool					unpack = false;
+	char *					batchSource = NULL;
+	char *					outputDirectory = ".";
+	long					workers = sysconf(_SC_NPROCESSORS_ONLN);
 	ssize_t					size = 64 * 1024;
 	int						i = 1;
-	int						paramCount = argc;
+	int						paramCount;
 
 	/* no reason to use a getopt implementation for our simple calling convention */
-	if (paramCount > i)
+	while (i < argc && *argv[i] == '-')
 	{
 		char *				sizeString = NULL;
 
-		if (strcmp(argv[i], "-s") == 0)
+		if (strcmp(argv[i], "-a") == 0 || strcmp(argv[i], "--all") == 0)
 		{
-			if (paramCount > i + 1)
+			listAll = true;
+			i += 1;
+		}
+		else if (strcmp(argv[i], "-u") == 0 || strcmp(argv[i], "--unpack") == 0)
+		{
+			unpack = true;
+			i += 1;
+		}
+		else if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "-j") == 0)
+		{
+			if (i + 1 >= argc)
+			{
+				fprintf(stderr, "Missing value after option '%s'.\n", argv[i]);
+				exit(2);
+			}
+			if (*(argv[i] + 1) == 'b') batchSource = argv[i + 1];
+			else if (*(argv[i] + 1) == 'o') outputDirectory = argv[i + 1];
+			else if ((workers = atoi(argv[i + 1])) <= 0)
+			{
+				fprintf(stderr, "Missing or invalid numeric value for number of workers.\n");
+				exit(2);
+			}
+			i += 2;
+		}
+		else if (strncmp(argv[i], "--batch=", 8) == 0)
+		{
+			batchSource = argv[i] + 8;
+			i += 1;
+		}
+		else if (strcmp(argv[i], "-s") == 0)
+		{
+			if (i + 1 < argc)
 			{
 				sizeString = argv[i + 1];
 				i += 2;
-				paramCount -= 2;
 			}
 			else
 			{
@@ -209,8 +558,8 @@ int main(int argc, char * argv[])
 			sizeString = strchr(argv[i], '=');
 			sizeString++; /* skip equal sign */
 			i += 1;
-			paramCount -= 1;
 		}
+		else break;
 
 		if (sizeString != NULL)
 		{
@@ -236,47 +585,136 @@ int main(int argc, char * argv[])
 		}
 	}
 
+	paramCount = argc - i + 1;
+
+	if (batchSource != NULL)
+	{
+		bool				prepared = true;
+
+		if (listAll)
+		{
+			fprintf(stderr, "The -a (or --all) option can't be used together with -b (or --batch).\n");
+			exit(2);
+		}
+
+		if (workers <= 0) workers = 1;
+
+		// an optional DTB file is the only parameter in batch mode
+		if (paramCount > 1)
+		{
+			prepared = false;
+			if (openMemoryMappedFile(&dtb, argv[i], "device tree BLOB", O_RDONLY, PROT_READ, MAP_SHARED))
+			{
+				if (fdt_check_header(dtb.fileBuffer) == 0)
+				{
+					prepared = prepareDeviceTreeSearch(&search, dtb.fileBuffer, dtb.fileStat.st_size);
+					useSearch = prepared;
+				}
+				else
+				{
+					fprintf(stderr, "The specified device tree BLOB file '%s' seems to be invalid.\n", dtb.fileName);
+				}
+			}
+		}
+
+		if (prepared) returnCode = processBatch(batchSource, outputDirectory, workers, (useSearch ? &search : NULL), size, unpack);
+
+		if (useSearch) releaseDeviceTreeSearch(&search);
+		if (paramCount > 1) closeMemoryMappedFile(&dtb);
+
+		exit(returnCode);
+	}
+
 	if (paramCount < 2)
 	{
 		usage();
 		exit(1);
 	}
 
-	if (openMemoryMappedFile(&kernel, argv[i], "unpacked kernel", O_RDONLY | O_SYNC, PROT_READ, MAP_SHARED))
+	// a packed kernel is scanned while it's decompressed, if only the FDT signature has to be found
+	if (unpack && !listAll && paramCount == 2)
 	{
+		int					fd = (strcmp(argv[i], "-") == 0 ? 0 : open(argv[i], O_RDONLY));
+		void *				configArea = malloc(size);
+		size_t				areaOffset = 0;
+		unsigned int		matches = 0;
+
+		if (fd == -1) fprintf(stderr, "Error %d opening packed kernel file '%s'.\n", errno, argv[i]);
+		else if (configArea == NULL) fprintf(stderr, "Error %d allocating memory for the config area.\n", errno);
+		else if (streamPackedKernel(fd, argv[i], size, configArea, &areaOffset, &matches))
+		{
+			if (write(1, configArea, size) == size) returnCode = 0;
+			else fprintf(stderr, "Error %d writing config area content.\n", errno);
+		}
+		else if (matches == 0) fprintf(stderr, "Unable to locate the config area in the specified kernel image.\n");
+		else fprintf(stderr, "Unexpected config area content found, extraction aborted.\n");
+
+		if (fd > 0) close(fd);
+		free(configArea);
+
+		exit(returnCode);
+	}
+
+	if (openKernelImage(&kernel, argv[i], unpack))
+	{
+		bool				prepared = true;
+
 		if (paramCount > 2)
 		{
+			prepared = false;
 			if (openMemoryMappedFile(&dtb, argv[i + 1], "device tree BLOB", O_RDONLY | O_SYNC, PROT_READ, MAP_SHARED))
 			{
 				if (fdt_check_header(dtb.fileBuffer) == 0)
 				{
-					if ((dtbLocation = findDeviceTreeImage(kernel.fileBuffer, kernel.fileStat.st_size, dtb.fileBuffer, dtb.fileStat.st_size)) == NULL)
-					{
-						fprintf(stderr, "The specified device tree BLOB was not found in the kernel image.\n");
-					}
+					prepared = prepareDeviceTreeSearch(&search, dtb.fileBuffer, dtb.fileStat.st_size);
+					useSearch = prepared;
 				}
 				else
 				{
 					fprintf(stderr, "The specified device tree BLOB file '%s' seems to be invalid.\n", dtb.fileName);
 				}
 			}
-			closeMemoryMappedFile(&dtb);
 		}
-		else
+
+		if (prepared && listAll)
 		{
-			if ((dtbLocation = locateDeviceTreeSignature(kernel.fileBuffer, kernel.fileStat.st_size)) == NULL)
+			void *							dtbLocation = NULL;
+			unsigned int					matches = 0;
+
+			while ((dtbLocation = nextDeviceTreeLocation(kernel.fileBuffer, kernel.fileStat.st_size, (useSearch ? &search : NULL), dtbLocation)) != NULL)
 			{
-				fprintf(stderr, "Unable to locate the config area in the specified kernel image.\n");
+				size_t						areaOffset = ((dtbLocation - kernel.fileBuffer) >> 12) << 12;
+				void *							configArea = NULL;
+
+				matches++;
+
+				// the area has to be completely contained in the kernel image
+				if (areaOffset + size <= (size_t) kernel.fileStat.st_size) configArea = findConfigArea(dtbLocation, size);
+
+				if (configArea != NULL) fprintf(stdout, "0x%08zx\t0x%08zx\n", (size_t) (dtbLocation - kernel.fileBuffer), areaOffset);
+				else fprintf(stdout, "0x%08zx\t-\n", (size_t) (dtbLocation - kernel.fileBuffer));
 			}
-		}
 
-		if (dtbLocation != NULL)
+			if (matches == 0)
+			{
+				if (useSearch) fprintf(stderr, "The specified device tree BLOB was not found in the kernel image.\n");
+				else fprintf(stderr, "Unable to locate the config area in the specified kernel image.\n");
+			}
+			else returnCode = 0;
+		}
+		else if (prepared)
 		{
-			struct _avm_kernel_config * *configArea = findConfigArea(dtbLocation, size);
+			unsigned int					matches = 0;
+			void *							configArea = locateConfigArea(kernel.fileBuffer, kernel.fileStat.st_size, (useSearch ? &search : NULL), size, &matches);
 
-			if (configArea != NULL)
+			if (matches == 0)
+			{
+				if (useSearch) fprintf(stderr, "The specified device tree BLOB was not found in the kernel image.\n");
+				else fprintf(stderr, "Unable to locate the config area in the specified kernel image.\n");
+			}
+			else if (configArea != NULL)
 			{
-				ssize_t	written = write(1, (void *) configArea, size);
+				ssize_t	written = write(1, configArea, size);
 
 				if (written == size)
 				{
@@ -292,9 +730,11 @@ int main(int argc, char * argv[])
 				fprintf(stderr, "Unexpected config area content found, extraction aborted.\n");
 			}
 		}
+
+		if (useSearch) releaseDeviceTreeSearch(&search);
+		if (paramCount > 2) closeMemoryMappedFile(&dtb);
 		closeMemoryMappedFile(&kernel);
 	}
 
 	exit(returnCode);
 }
-
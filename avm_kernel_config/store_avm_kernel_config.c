@@ -0,0 +1,750 @@
+// vim: set tabstop=4 syntax=c :
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/***********************************************************************
+ *                                                                     *
+ *                                                                     *
+ * Copyright (C) 2016-2021 P.Hämmerlein (http://www.yourfritz.de)      *
+ *                                                                     *
+ * This program is free software; you can redistribute it and/or       *
+ * modify it under the terms of the GNU General Public License         *
+ * as published by the Free Software Foundation; either version 2      *
+ * of the License, or (at your option) any later version.              *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program, please look for the file COPYING.          *
+ *                                                                     *
+ ***********************************************************************/
+
+#define _DEFAULT_SOURCE
+#include "avm_kernel_config_helpers.h"
+#include <stdarg.h>
+
+#define MANIFEST_HEADER			"# avm_kernel_config manifest"
+#define MODULE_ENTRY_SIZE		(4 * sizeof(uint32_t))
+#define RAW_GAP					8
+
+void usage()
+{
+
+	fprintf(stderr, "store_avm_kernel_config - content-addressed store for kernel config areas\n\n");
+	fprintf(stderr, "(C) 2016-2021 P. Hämmerlein (http://www.yourfritz.de)\n\n");
+	fprintf(stderr, "Licensed under GPLv2, see LICENSE file from source repository.\n\n");
+	fprintf(stderr, "Usage:\n\n");
+	fprintf(stderr, "store_avm_kernel_config put <store_directory> <binary_config_area_file> [<manifest_name>]\n");
+	fprintf(stderr, "store_avm_kernel_config get [ -S ] <store_directory> <manifest_name>\n");
+	fprintf(stderr, "\nThe 'put' command splits the config area into its parts (each device");
+	fprintf(stderr, "\ntree, the version info and the module memory table) and stores each");
+	fprintf(stderr, "\npart with its SHA-256 hash as name below 'objects' in the store");
+	fprintf(stderr, "\ndirectory - identical parts of different areas are stored only once.");
+	fprintf(stderr, "\nThe layout of the area (size, endianess, base address, the offsets");
+	fprintf(stderr, "\nand hashes of the parts, the offsets of the module names and all the");
+	fprintf(stderr, "\nremaining data as hexadecimal values) is written to a text file below");
+	fprintf(stderr, "\n'manifests', its name is the name of the area file, if no other name");
+	fprintf(stderr, "\nwas specified.\n");
+	fprintf(stderr, "\nThe 'get' command rebuilds the area from a manifest and writes it to");
+	fprintf(stderr, "\nSTDOUT - or the assembler source for the area, if -S was specified.\n");
+
+}
+
+//	SHA-256 (FIPS 180-4)
+
+struct sha256Context
+{
+	uint32_t			state[8];
+	uint64_t			length;
+	uint8_t				block[64];
+	size_t				used;
+};
+
+static const uint32_t	sha256Constants[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n)				(((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256Block(struct sha256Context *context, const uint8_t *data)
+{
+	uint32_t			w[64];
+	uint32_t			a, b, c, d, e, f, g, h;
+
+	for (int i = 0; i < 16; i++)
+		w[i] = (uint32_t) data[i * 4] << 24 | (uint32_t) data[i * 4 + 1] << 16 | (uint32_t) data[i * 4 + 2] << 8 | data[i * 4 + 3];
+	for (int i = 16; i < 64; i++)
+		w[i] = w[i - 16] + (ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 7] + (ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10));
+
+	a = context->state[0]; b = context->state[1]; c = context->state[2]; d = context->state[3];
+	e = context->state[4]; f = context->state[5]; g = context->state[6]; h = context->state[7];
+
+	for (int i = 0; i < 64; i++)
+	{
+		uint32_t		t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256Constants[i] + w[i];
+		uint32_t		t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	context->state[0] += a; context->state[1] += b; context->state[2] += c; context->state[3] += d;
+	context->state[4] += e; context->state[5] += f; context->state[6] += g; context->state[7] += h;
+}
+
+static void sha256Init(struct sha256Context *context)
+{
+	static const uint32_t	initial[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+	memcpy(context->state, initial, sizeof(initial));
+	context->length = 0;
+	context->used = 0;
+}
+
+static void sha256Update(struct sha256Context *context, const void *data, size_t size)
+{
+	const uint8_t *		input = (const uint8_t *) data;
+
+	context->length += size;
+
+	if (context->used > 0)
+	{
+		size_t			count = 64 - context->used;
+
+		if (count > size) count = size;
+		memcpy(context->block + context->used, input, count);
+		context->used += count;
+		input += count;
+		size -= count;
+		if (context->used < 64) return;
+		sha256Block(context, context->block);
+		context->used = 0;
+	}
+
+	while (size >= 64)
+	{
+		sha256Block(context, input);
+		input += 64;
+		size -= 64;
+	}
+
+	memcpy(context->block, input, size);
+	context->used = size;
+}
+
+static void sha256Final(struct sha256Context *context, char *hex)
+{
+	uint64_t			bits = context->length * 8;
+	uint8_t				padding = 0x80;
+	uint8_t				length[8];
+
+	sha256Update(context, &padding, 1);
+	padding = 0;
+	while (context->used != 56) sha256Update(context, &padding, 1);
+	for (int i = 0; i < 8; i++) length[i] = bits >> (56 - i * 8);
+	sha256Update(context, length, 8);
+
+	for (int i = 0; i < 8; i++) sprintf(hex + i * 8, "%08x", context->state[i]);
+}
+
+static void sha256(const void *data, size_t size, char *hex)
+{
+	struct sha256Context	context;
+
+	sha256Init(&context);
+	sha256Update(&context, data, size);
+	sha256Final(&context, hex);
+}
+
+//	object store
+//
+//	- objects are stored as '<store>/objects/<first two hash digits>/<hash>', existing objects are never written
+//	  again, new ones are written to a temporary file first and renamed afterwards
+//	- manifests are stored as '<store>/manifests/<name>'
+
+static bool createDirectory(const char *path)
+{
+
+	if (mkdir(path, 0755) == 0 || errno == EEXIST) return true;
+	fprintf(stderr, "Error %d creating directory '%s'.\n", errno, path);
+	return false;
+}
+
+static bool writeFile(const char *fileName, const void *data, size_t size)
+{
+	char *				tempName = malloc(strlen(fileName) + 16);
+	int					fd;
+	bool				result = false;
+
+	if (tempName == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for a file name.\n", errno);
+		return false;
+	}
+	sprintf(tempName, "%s.tmp%u", fileName, (unsigned int) getpid());
+
+	if ((fd = open(tempName, O_WRONLY | O_CREAT | O_TRUNC, 0644)) != -1)
+	{
+		if (write(fd, data, size) == (ssize_t) size && close(fd) == 0)
+		{
+			if (rename(tempName, fileName) == 0) result = true;
+			else fprintf(stderr, "Error %d renaming '%s' to '%s'.\n", errno, tempName, fileName);
+		}
+		else
+		{
+			fprintf(stderr, "Error %d writing file '%s'.\n", errno, tempName);
+			close(fd);
+		}
+		if (!result) unlink(tempName);
+	}
+	else fprintf(stderr, "Error %d creating file '%s'.\n", errno, tempName);
+
+	free(tempName);
+
+	return result;
+}
+
+static char * objectPath(const char *store, const char *hash)
+{
+	char *				path = malloc(strlen(store) + 80);
+
+	if (path == NULL) fprintf(stderr, "Error %d allocating memory for a file name.\n", errno);
+	else sprintf(path, "%s/objects/%.2s/%s", store, hash, hash);
+
+	return path;
+}
+
+static bool putObject(const char *store, const void *data, size_t size, char *hash)
+{
+	char *				path;
+	struct stat			st;
+	bool				result = false;
+
+	sha256(data, size, hash);
+
+	if ((path = objectPath(store, hash)) == NULL) return false;
+
+	if (stat(path, &st) == 0 && (size_t) st.st_size == size) result = true;
+	else
+	{
+		char *			directory = strrchr(path, '/');
+
+		*directory = 0;
+		if (createDirectory(path))
+		{
+			*directory = '/';
+			result = writeFile(path, data, size);
+		}
+	}
+
+	free(path);
+
+	return result;
+}
+
+static void * getObject(const char *store, const char *hash, size_t *size)
+{
+	char *				path;
+	struct memoryMappedFile	object;
+	void *				data = NULL;
+	char				check[65];
+
+	if ((path = objectPath(store, hash)) == NULL) return NULL;
+
+	if (openMemoryMappedFile(&object, path, "object", O_RDONLY, PROT_READ, MAP_SHARED))
+	{
+		*size = object.fileStat.st_size;
+		sha256(object.fileBuffer, *size, check);
+
+		if (strcmp(check, hash) != 0) fprintf(stderr, "The content of object '%s' doesn't match its hash.\n", path);
+		else if ((data = malloc(*size + 1)) == NULL) fprintf(stderr, "Error %d allocating memory for object '%s'.\n", errno, path);
+		else
+		{
+			memcpy(data, object.fileBuffer, *size);
+			((char *) data)[*size] = 0;
+		}
+		closeMemoryMappedFile(&object);
+	}
+
+	free(path);
+
+	return data;
+}
+
+//	area layout
+//
+//	- each device tree is stored as it is (the size from its header), the version info as the whole structure
+//	- the module memory table contains kernel addresses, which change with each layout, so its object contains
+//	  a line per module with name and sizes and the manifest contains the offset of each name in the area
+//	- all bytes of the area, which aren't covered by one of these parts (the pointer to the entries array, the
+//	  entries array, padding, ...) are stored in the manifest as ranges of hexadecimal values, zero bytes are
+//	  omitted, if there are more than RAW_GAP of them in a row
+
+struct manifestBuffer
+{
+	char *				text;
+	size_t				used;
+	size_t				allocated;
+};
+
+static bool manifestAppend(struct manifestBuffer *manifest, const char *format, ...)
+{
+	va_list				args;
+	int					size;
+
+	va_start(args, format);
+	size = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+
+	if (manifest->used + size + 1 > manifest->allocated)
+	{
+		size_t			allocated = (manifest->allocated ? manifest->allocated * 2 : 4096);
+		char *			text;
+
+		while (manifest->used + size + 1 > allocated) allocated *= 2;
+		if ((text = realloc(manifest->text, allocated)) == NULL)
+		{
+			fprintf(stderr, "Error %d allocating memory for the manifest.\n", errno);
+			return false;
+		}
+		manifest->text = text;
+		manifest->allocated = allocated;
+	}
+
+	va_start(args, format);
+	vsnprintf(manifest->text + manifest->used, size + 1, format, args);
+	va_end(args);
+	manifest->used += size;
+
+	return true;
+}
+
+static void putValue(uint8_t *buffer, size_t offset, uint32_t value, bool bigEndian)
+{
+
+	if (bigEndian)
+	{
+		buffer[offset] = value >> 24;
+		buffer[offset + 1] = value >> 16;
+		buffer[offset + 2] = value >> 8;
+		buffer[offset + 3] = value;
+	}
+	else
+	{
+		buffer[offset] = value;
+		buffer[offset + 1] = value >> 8;
+		buffer[offset + 2] = value >> 16;
+		buffer[offset + 3] = value >> 24;
+	}
+}
+
+static bool isBigEndian(const struct configAreaView *view)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	return view->index.swapNeeded;
+#else
+	return !view->index.swapNeeded;
+#endif
+}
+
+int putConfigArea(const char *store, const char *areaFile, const char *manifestName)
+{
+	struct memoryMappedFile	input;
+	struct configAreaView	view;
+	struct manifestBuffer	manifest = { NULL, 0, 0 };
+	struct configAreaModule	module;
+	uint8_t *			covered = NULL;
+	char				hash[65];
+	char *				path = NULL;
+	bool				result = false;
+	unsigned int		modules = 0;
+
+	if (!openMemoryMappedFile(&input, areaFile, "input", O_RDONLY, PROT_READ, MAP_SHARED)) return 1;
+
+	if (!openConfigAreaView(&view, input.fileBuffer, input.fileStat.st_size))
+	{
+		fprintf(stderr, "Unable to identify the specified config area dump file, may be it's empty.\n");
+		goto cleanup;
+	}
+
+	if ((covered = calloc(view.size, 1)) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the area map.\n", errno);
+		goto cleanup;
+	}
+
+	if (!createDirectory(store) || !(path = malloc(strlen(store) + strlen(manifestName) + 16))) goto cleanup;
+	sprintf(path, "%s/objects", store);
+	if (!createDirectory(path)) goto cleanup;
+	sprintf(path, "%s/manifests", store);
+	if (!createDirectory(path)) goto cleanup;
+
+	if (!manifestAppend(&manifest, "%s\nSIZE %zu\nENDIANESS %s\nBASE 0x%08x\n", MANIFEST_HEADER, view.size, (isBigEndian(&view) ? "BE" : "LE"), view.index.kernelOffset)) goto cleanup;
+
+	// device trees
+	for (unsigned int subRev = 0; subRev <= avm_kernel_config_tags_device_tree_subrev_last - avm_kernel_config_tags_device_tree_subrev_0; subRev++)
+	{
+		unsigned int	tag = avm_kernel_config_tags_device_tree_subrev_0 + subRev;
+		uint32_t		offset = view.index.offsets[tag];
+		uint32_t		dtbSize;
+
+		if (!hasConfigAreaEntry(&view.index, tag) || offset + 8 > view.size) continue;
+
+		dtbSize = (uint32_t) view.area[offset + 4] << 24 | (uint32_t) view.area[offset + 5] << 16 | (uint32_t) view.area[offset + 6] << 8 | view.area[offset + 7];
+		if (dtbSize > view.size - offset) dtbSize = view.size - offset;
+
+		if (!putObject(store, view.area + offset, dtbSize, hash)) goto cleanup;
+		if (!manifestAppend(&manifest, "DTB %u 0x%05x %u %s\n", subRev, offset, dtbSize, hash)) goto cleanup;
+		memset(covered + offset, 1, dtbSize);
+	}
+
+	// version info
+	if (hasConfigAreaEntry(&view.index, avm_kernel_config_tags_version_info))
+	{
+		uint32_t		offset = view.index.offsets[avm_kernel_config_tags_version_info];
+		uint32_t		size = sizeof(struct _avm_kernel_version_info);
+
+		if (size > view.size - offset) size = view.size - offset;
+
+		if (!putObject(store, view.area + offset, size, hash)) goto cleanup;
+		if (!manifestAppend(&manifest, "VERSION 0x%05x %u %s\n", offset, size, hash)) goto cleanup;
+		memset(covered + offset, 1, size);
+	}
+
+	// module memory table
+	if (hasConfigAreaEntry(&view.index, avm_kernel_config_tags_module_memory))
+	{
+		uint32_t				offset = view.index.offsets[avm_kernel_config_tags_module_memory];
+		struct manifestBuffer	table = { NULL, 0, 0 };
+		struct manifestBuffer	names = { NULL, 0, 0 };
+		bool					success = true;
+
+		while (success && getConfigAreaModule(&view, modules, &module))
+		{
+			size_t				nameOffset = (const uint8_t *) module.name - view.area;
+
+			success = manifestAppend(&table, "%s %u %u %u\n", module.name, module.coreSize, module.symbolSize, module.symbolTextSize) &&
+				manifestAppend(&names, "NAME %u 0x%05zx\n", modules, nameOffset);
+			memset(covered + offset + modules * MODULE_ENTRY_SIZE, 1, MODULE_ENTRY_SIZE);
+			memset(covered + nameOffset, 1, strlen(module.name) + 1);
+			modules++;
+		}
+
+		if (success) success = putObject(store, (table.text ? table.text : ""), table.used, hash);
+		if (success) success = manifestAppend(&manifest, "MODULES 0x%05x %u %s\n%s", offset, modules, hash, (names.text ? names.text : ""));
+		free(table.text);
+		free(names.text);
+		if (!success) goto cleanup;
+	}
+
+	// everything else
+	for (size_t offset = 0; offset < view.size; )
+	{
+		size_t				end = offset;
+
+		if (covered[offset] || view.area[offset] == 0)
+		{
+			offset++;
+			continue;
+		}
+
+		// a range ends at a covered byte or at more than RAW_GAP zero bytes
+		for (size_t next = offset; next < view.size && !covered[next] && next - end <= RAW_GAP; next++)
+		{
+			if (view.area[next] != 0) end = next + 1;
+		}
+
+		if (!manifestAppend(&manifest, "RAW 0x%05zx ", offset)) goto cleanup;
+		for (size_t i = offset; i < end; i++)
+		{
+			if (!manifestAppend(&manifest, "%02x", view.area[i])) goto cleanup;
+		}
+		if (!manifestAppend(&manifest, "\n")) goto cleanup;
+
+		offset = end;
+	}
+
+	sprintf(path, "%s/manifests/%s", store, manifestName);
+	if (writeFile(path, manifest.text, manifest.used))
+	{
+		fprintf(stdout, "%s\n", path);
+		result = true;
+	}
+
+cleanup:
+	free(manifest.text);
+	free(covered);
+	free(path);
+	closeMemoryMappedFile(&input);
+
+	return (result ? 0 : 1);
+}
+
+//	rebuild an area from a manifest
+
+static bool placeObject(const char *store, const char *hash, uint8_t *area, size_t areaSize, size_t offset, size_t size)
+{
+	void *				data;
+	size_t				dataSize;
+	bool				result = false;
+
+	if ((data = getObject(store, hash, &dataSize)) == NULL) return false;
+
+	if (dataSize != size || offset > areaSize || size > areaSize - offset) fprintf(stderr, "Object '%s' doesn't fit into the area.\n", hash);
+	else
+	{
+		memcpy(area + offset, data, size);
+		result = true;
+	}
+	free(data);
+
+	return result;
+}
+
+static bool placeModules(const char *store, const char *hash, uint8_t *area, size_t areaSize, size_t offset, unsigned int count, const uint32_t *nameOffsets, uint32_t base, bool bigEndian)
+{
+	char *				table;
+	char *				line;
+	size_t				tableSize;
+	unsigned int		number = 0;
+
+	if ((table = getObject(store, hash, &tableSize)) == NULL) return false;
+
+	line = table;
+	while (number < count && *line)
+	{
+		char *			end = strchr(line, '\n');
+		char *			sizes;
+		unsigned int	coreSize, symbolSize, symbolTextSize;
+		size_t			nameLength;
+
+		if (end == NULL) break;
+		*end = 0;
+
+		// the name is followed by three numbers, it doesn't contain any spaces
+		if ((sizes = strchr(line, ' ')) == NULL || sscanf(sizes, "%u %u %u", &coreSize, &symbolSize, &symbolTextSize) != 3) break;
+		nameLength = sizes - line;
+
+		if (offset + (number + 1) * MODULE_ENTRY_SIZE > areaSize || nameOffsets[number] + nameLength + 1 > areaSize) break;
+
+		memcpy(area + nameOffsets[number], line, nameLength);
+		area[nameOffsets[number] + nameLength] = 0;
+		putValue(area, offset + number * MODULE_ENTRY_SIZE, base + nameOffsets[number], bigEndian);
+		putValue(area, offset + number * MODULE_ENTRY_SIZE + 4, coreSize, bigEndian);
+		putValue(area, offset + number * MODULE_ENTRY_SIZE + 8, symbolSize, bigEndian);
+		putValue(area, offset + number * MODULE_ENTRY_SIZE + 12, symbolTextSize, bigEndian);
+
+		number++;
+		line = end + 1;
+	}
+
+	free(table);
+
+	if (number != count) fprintf(stderr, "The module memory table '%s' doesn't match the manifest.\n", hash);
+
+	return (number == count);
+}
+
+static int hexValue(char c)
+{
+
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+int getConfigArea(const char *store, const char *manifestName, bool source)
+{
+	struct memoryMappedFile	input;
+	char *				path;
+	char *				text = NULL;
+	char *				line;
+	uint8_t *			area = NULL;
+	size_t				areaSize = 0;
+	uint32_t			base = 0;
+	bool				bigEndian = true;
+	uint32_t *			nameOffsets = NULL;
+	char				modulesHash[65] = "";
+	size_t				modulesOffset = 0;
+	unsigned int		modules = 0;
+	bool				result = false;
+
+	if ((path = malloc(strlen(store) + strlen(manifestName) + 16)) == NULL) return 1;
+	sprintf(path, "%s/manifests/%s", store, manifestName);
+
+	if (!openMemoryMappedFile(&input, path, "manifest", O_RDONLY, PROT_READ, MAP_SHARED))
+	{
+		free(path);
+		return 1;
+	}
+
+	if ((text = malloc(input.fileStat.st_size + 1)) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the manifest.\n", errno);
+		goto cleanup;
+	}
+	memcpy(text, input.fileBuffer, input.fileStat.st_size);
+	text[input.fileStat.st_size] = 0;
+
+	if (strncmp(text, MANIFEST_HEADER "\n", strlen(MANIFEST_HEADER) + 1) != 0)
+	{
+		fprintf(stderr, "The file '%s' isn't a manifest.\n", path);
+		goto cleanup;
+	}
+
+	for (line = text; *line; )
+	{
+		char *			end = strchr(line, '\n');
+		char			keyword[16];
+		char			hash[65];
+		unsigned int	number;
+		unsigned int	offset;
+		unsigned int	size;
+		bool			valid = true;
+
+		if (end != NULL) *end = 0;
+
+		if (*line == '#' || *line == 0) valid = true;
+		else if (sscanf(line, "%15s", keyword) != 1) valid = false;
+		else if (strcmp(keyword, "SIZE") == 0)
+		{
+			valid = (sscanf(line, "SIZE %zu", &areaSize) == 1 && areaSize > 0 && area == NULL && (area = calloc(areaSize, 1)) != NULL);
+		}
+		else if (strcmp(keyword, "ENDIANESS") == 0)
+		{
+			bigEndian = (strcmp(line, "ENDIANESS BE") == 0);
+		}
+		else if (strcmp(keyword, "BASE") == 0)
+		{
+			valid = (sscanf(line, "BASE %x", &base) == 1);
+		}
+		else if (area == NULL) valid = false;
+		else if (strcmp(keyword, "DTB") == 0)
+		{
+			valid = (sscanf(line, "DTB %u %x %u %64s", &number, &offset, &size, hash) == 4 && placeObject(store, hash, area, areaSize, offset, size));
+		}
+		else if (strcmp(keyword, "VERSION") == 0)
+		{
+			valid = (sscanf(line, "VERSION %x %u %64s", &offset, &size, hash) == 3 && placeObject(store, hash, area, areaSize, offset, size));
+		}
+		else if (strcmp(keyword, "MODULES") == 0)
+		{
+			valid = (sscanf(line, "MODULES %x %u %64s", &offset, &modules, modulesHash) == 3 && modules < areaSize && nameOffsets == NULL &&
+				(nameOffsets = calloc(modules + 1, sizeof(uint32_t))) != NULL);
+			modulesOffset = offset;
+		}
+		else if (strcmp(keyword, "NAME") == 0)
+		{
+			valid = (sscanf(line, "NAME %u %x", &number, &offset) == 2 && nameOffsets != NULL && number < modules);
+			if (valid) nameOffsets[number] = offset;
+		}
+		else if (strcmp(keyword, "RAW") == 0)
+		{
+			char *		hex;
+
+			valid = (sscanf(line, "RAW %x", &offset) == 1 && (hex = strchr(line + 4, ' ')) != NULL);
+			if (valid)
+			{
+				for (hex++; valid && *hex && *(hex + 1); hex += 2, offset++)
+				{
+					int	high = hexValue(*hex);
+					int	low = hexValue(*(hex + 1));
+
+					if (high < 0 || low < 0 || offset >= areaSize) valid = false;
+					else area[offset] = (high << 4) | low;
+				}
+			}
+		}
+		else valid = false;
+
+		if (!valid)
+		{
+			fprintf(stderr, "Invalid line in manifest '%s': %s\n", path, line);
+			goto cleanup;
+		}
+
+		if (end == NULL) break;
+		line = end + 1;
+	}
+
+	if (area == NULL)
+	{
+		fprintf(stderr, "The manifest '%s' doesn't contain the area size.\n", path);
+		goto cleanup;
+	}
+
+	if (nameOffsets != NULL && !placeModules(store, modulesHash, area, areaSize, modulesOffset, modules, nameOffsets, base, bigEndian)) goto cleanup;
+
+	if (source)
+	{
+		struct configAreaView	view;
+
+		if (!openConfigAreaView(&view, area, areaSize)) fprintf(stderr, "Unable to identify the rebuilt config area.\n");
+		else result = (writeConfigAreaSource(&view, 1, NULL) == 0);
+	}
+	else
+	{
+		result = (write(1, area, areaSize) == (ssize_t) areaSize);
+		if (!result) fprintf(stderr, "Error %d writing the config area.\n", errno);
+	}
+
+cleanup:
+	free(nameOffsets);
+	free(area);
+	free(text);
+	free(path);
+	closeMemoryMappedFile(&input);
+
+	return (result ? 0 : 1);
+}
+
+int main(int argc, char * argv[])
+{
+	int						returnCode = 1;
+
+	if (argc >= 4 && argc <= 5 && strcmp(argv[1], "put") == 0)
+	{
+		const char *		manifestName = (argc == 5 ? argv[4] : strrchr(argv[3], '/'));
+
+		if (manifestName == NULL) manifestName = argv[3];
+		else if (argc == 4) manifestName++;
+
+		if (strchr(manifestName, '/') != NULL || *manifestName == 0 || *manifestName == '.')
+		{
+			fprintf(stderr, "Invalid manifest name '%s'.\n", manifestName);
+			exit(1);
+		}
+
+		returnCode = putConfigArea(argv[2], argv[3], manifestName);
+	}
+	else if (argc >= 4 && argc <= 5 && strcmp(argv[1], "get") == 0)
+	{
+		bool				source = (argc == 5 && strcmp(argv[2], "-S") == 0);
+
+		if (argc == 5 && !source)
+		{
+			usage();
+			exit(1);
+		}
+
+		if (isatty(1))
+		{
+			fprintf(stderr, "The %s will be written to STDOUT, please redirect it to any location.\n", (source ? "assembler source" : "config area"));
+			exit(1);
+		}
+
+		returnCode = getConfigArea(argv[argc - 2], argv[argc - 1], source);
+	}
+	else usage();
+
+	exit(returnCode);
+}
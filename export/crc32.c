@@ -1,39 +1,503 @@
-/* simple implementation of CRC32 checksum as short C program */
+/* CRC32 checksum (LE polynomial 0xEDB88320, all ones as initial value and final XOR) as short C program */
 /* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * The data from STDIN is read with large blocks and the checksum is computed with the fastest available
+ * implementation, which is selected at runtime:
+ *
+ * - carry-less multiplication (PCLMULQDQ) on x86 CPUs supporting it
+ * - the CRC32 instructions on ARMv8 CPUs supporting them
+ * - 'slicing-by-16' (and 'slicing-by-8' for the remainder) with lookup tables as portable fallback
+ *
+ * The implementations are located in 'crc32_engine.h', the processing of settings exports (see below) in
+ * 'export_checksum.h' - both are shared with 'export_parts.c'.
+ *
+ * The lookup tables are generated at compile time, the file 'crc32_table.h' was created with:
+ *
+ * gcc -DMAKECRCH -o makecrch crc32.c && ./makecrch >crc32_table.h
+ *
+ * Files specified on the command line are mapped to memory instead. Large files are split into chunks, which
+ * are processed by multiple threads, and the partial CRC values are merged afterwards.
+ *
+ * With option '-e' the checksum of a FRITZ!OS settings export is computed in a single pass, without the need
+ * to create an intermediate file with the canonicalized data.
+ *
+ * The result is written as 8 uppercase hexadecimal digits followed by a newline (one line per file), like it
+ * was done by the first version of this program.
+ */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "crc32_engine.h"
+
+#define READ_BUFFER_SIZE		(256 * 1024)
+#define PARALLEL_THRESHOLD		(8 * 1024 * 1024)
+#define MAX_THREADS				64
+
+#ifdef MAKECRCH
+
+/* generator for the lookup tables */
 int main()
 {
-	const uint32_t polynom=0xEDB88320;
-	uint32_t lookupTable[256];
-	uint32_t crcValue=0;
-	ssize_t readBytes=0;
-	uint8_t byte;
-	char buffer[256];
-	char *input;
-	int i;
-	int j;
-	for (i = 0;i < 256;i++) {
-		uint32_t val = (uint32_t) i;
-		for (j = 0;j < 8;j++) {
-			int isOne=((val & 1) == 1);
-			val >>= 1;
-			if (isOne) {
-				val ^= polynom;
-			}
+	static uint32_t	table[16][256];
+	int				i;
+	int				j;
+
+	for (i = 0; i < 256; i++)
+	{
+		uint32_t	value = (uint32_t) i;
+
+		for (j = 0; j < 8; j++) value = (value & 1 ? (value >> 1) ^ CRC32_POLYNOM : value >> 1);
+		table[0][i] = value;
+	}
+	for (i = 0; i < 256; i++)
+	{
+		for (j = 1; j < 16; j++) table[j][i] = (table[j - 1][i] >> 8) ^ table[0][table[j - 1][i] & 0xFF];
+	}
+
+	printf("/* crc32_table.h -- tables for the 'slicing-by-16' CRC32 implementation */\n");
+	printf("/* generated by 'crc32.c' with MAKECRCH defined, do not edit */\n");
+	printf("/* SPDX-License-Identifier: GPL-2.0-or-later */\n\n");
+	printf("static const uint32_t crc32Table[16][256] = {\n");
+	for (j = 0; j < 16; j++)
+	{
+		printf("\t{\n");
+		for (i = 0; i < 256; i++)
+		{
+			printf("%s0x%08" PRIx32 "%s", (i % 6 == 0 ? "\t\t" : ""), table[j][i], (i == 255 ? "\n" : (i % 6 == 5 ? ",\n" : ", ")));
 		}
-		lookupTable[i] = val;
+		printf("\t}%s\n", (j == 15 ? "" : ","));
+	}
+	printf("};\n");
+
+	return 0;
+}
+
+#else
+
+#include "export_checksum.h"
+
+static uint32_t crc32Stream(int fd)
+{
+	uint32_t		crcValue = ~((uint32_t) 0);
+	ssize_t			readBytes;
+	uint8_t *		buffer;
+
+	if ((buffer = malloc(READ_BUFFER_SIZE)) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the read buffer.\n", errno);
+		exit(1);
 	}
-	crcValue = ~crcValue;
-	do {
-		for (input = buffer;input < (buffer+readBytes);input++) {
-			byte = *input;
-			crcValue = (crcValue >> 8) ^ lookupTable[(crcValue & 255) ^ byte];
+
+	while ((readBytes = read(fd, buffer, READ_BUFFER_SIZE)) != 0)
+	{
+		if (readBytes == -1)
+		{
+			if (errno == EINTR) continue;
+			fprintf(stderr, "Error %d reading input data.\n", errno);
+			free(buffer);
+			exit(1);
 		}
-		readBytes = read(0, buffer, sizeof(buffer));
-	} while (readBytes > 0);
-	crcValue = ~crcValue;
-	printf("%08X\n",crcValue);
+		crcValue = crc32Update(crcValue, buffer, readBytes);
+	}
+
+	free(buffer);
+	return ~crcValue;
+}
+
+/* chunk of a memory mapped file, processed by its own thread */
+struct crc32Chunk
+{
+	pthread_t		thread;
+	const uint8_t *	data;
+	size_t			size;
+	uint32_t		crc;
+};
+
+static void * crc32ChunkWorker(void *arg)
+{
+	struct crc32Chunk *	chunk = (struct crc32Chunk *) arg;
+
+	chunk->crc = ~crc32Update(~((uint32_t) 0), chunk->data, chunk->size);
+	return NULL;
+}
+
+static uint32_t crc32Parallel(const uint8_t *data, size_t size, long threads)
+{
+	struct crc32Chunk *	chunks;
+	size_t				chunkSize;
+	uint32_t			crcValue;
+	long				started;
+	long				i;
+
+	/* chunks are multiples of 4K, each thread gets one of them */
+	chunkSize = (((size + threads - 1) / threads) + 4095) & ~((size_t) 4095);
+	threads = (size + chunkSize - 1) / chunkSize;
+
+	if ((chunks = calloc(threads, sizeof(struct crc32Chunk))) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the thread table.\n", errno);
+		exit(1);
+	}
+
+	for (i = 0; i < threads; i++)
+	{
+		chunks[i].data = data + i * chunkSize;
+		chunks[i].size = (i == threads - 1 ? size - i * chunkSize : chunkSize);
+	}
+
+	/* the first chunk is processed by the main thread, missing threads are replaced by it, too */
+	for (started = 1; started < threads; started++)
+	{
+		if (pthread_create(&chunks[started].thread, NULL, crc32ChunkWorker, &chunks[started]) != 0) break;
+	}
+	for (i = started; i < threads; i++) crc32ChunkWorker(&chunks[i]);
+	crc32ChunkWorker(&chunks[0]);
+
+	crcValue = chunks[0].crc;
+	for (i = 1; i < threads; i++)
+	{
+		if (i < started) pthread_join(chunks[i].thread, NULL);
+		crcValue = crc32Combine(crcValue, chunks[i].crc, chunks[i].size);
+	}
+
+	free(chunks);
+	return crcValue;
+}
+
+static int crc32File(const char *name, long threads, size_t threshold, uint32_t *crcValue)
+{
+	struct stat		st;
+	void *			data;
+	int				fd;
+
+	if ((fd = open(name, O_RDONLY)) == -1)
+	{
+		fprintf(stderr, "Error %d opening file '%s'.\n", errno, name);
+		return 1;
+	}
+
+	if (fstat(fd, &st) == -1)
+	{
+		fprintf(stderr, "Error %d getting attributes of file '%s'.\n", errno, name);
+		close(fd);
+		return 1;
+	}
+
+	/* anything else than a non-empty regular file is read like STDIN */
+	if (!S_ISREG(st.st_mode) || st.st_size == 0)
+	{
+		*crcValue = crc32Stream(fd);
+		close(fd);
+		return 0;
+	}
+
+	if ((data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+	{
+		fprintf(stderr, "Error %d mapping file '%s' to memory.\n", errno, name);
+		close(fd);
+		return 1;
+	}
+	close(fd);
+
+	if (threads > 1 && (size_t) st.st_size >= threshold)
+		*crcValue = crc32Parallel((const uint8_t *) data, st.st_size, threads);
+	else
+		*crcValue = ~crc32Update(~((uint32_t) 0), data, st.st_size);
+
+	munmap(data, st.st_size);
 	return 0;
 }
+
+/* checksum of an export file, which is processed line by line */
+enum exportPartType
+{
+	EXPORT_HEADER,
+	EXPORT_CFGFILE,
+	EXPORT_BINFILE,
+	EXPORT_CRYPTEDBINFILE,
+	EXPORT_BETWEEN,
+	EXPORT_END,
+};
+
+
+/* the marker lines of an export, returns the type and the name of the part */
+static enum exportPartType exportMarker(const char *line, size_t size, const char **name, size_t *nameSize)
+{
+	static const struct
+	{
+		const char *			prefix;
+		enum exportPartType		type;
+	}						markers[] = {
+		{ "**** CFGFILE:", EXPORT_CFGFILE },
+		{ "**** BINFILE:", EXPORT_BINFILE },
+		{ "**** CRYPTEDBINFILE:", EXPORT_CRYPTEDBINFILE },
+		{ "**** END OF FILE", EXPORT_BETWEEN },
+		{ "**** END OF EXPORT", EXPORT_END },
+	};
+	size_t					i;
+
+	size = exportLineLength(line, size);
+	for (i = 0; i < sizeof(markers) / sizeof(markers[0]); i++)
+	{
+		size_t		prefixSize = strlen(markers[i].prefix);
+
+		if (size >= prefixSize && memcmp(line, markers[i].prefix, prefixSize) == 0)
+		{
+			*name = line + prefixSize;
+			*nameSize = size - prefixSize;
+			return markers[i].type;
+		}
+	}
+
+	return EXPORT_HEADER;
+}
+
+static int exportChecksumStream(FILE *input, const char *name, uint32_t *crcValue)
+{
+	struct exportChecksum *	ctx;
+	enum exportPartType		state = EXPORT_HEADER;
+	char *					line = NULL;
+	size_t					lineSize = 0;
+	char *					held = NULL;
+	size_t					heldSize = 0;
+	ssize_t					heldLength = -1;
+	ssize_t					length;
+	int						rc = 0;
+
+	if ((ctx = malloc(sizeof(struct exportChecksum))) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the checksum buffer.\n", errno);
+		return 1;
+	}
+	exportReset(ctx);
+
+	while (state != EXPORT_END && (length = getline(&line, &lineSize, input)) != -1)
+	{
+		enum exportPartType	marker;
+		const char *		partName;
+		size_t				partNameSize;
+
+		marker = (length >= 4 && memcmp(line, "****", 4) == 0 ? exportMarker(line, length, &partName, &partNameSize) : EXPORT_HEADER);
+
+		if (marker == EXPORT_HEADER)
+		{
+			switch (state)
+			{
+				case EXPORT_HEADER:
+					exportAppendHeader(ctx, line, length);
+					break;
+
+				case EXPORT_CFGFILE:
+				{
+					char *		swap = held;
+					size_t		swapSize = heldSize;
+
+					/* the last line of the part is ignored, so each line is processed with one line delay */
+					if (heldLength != -1) exportAppendConfig(ctx, held, heldLength);
+					held = line;
+					heldSize = lineSize;
+					heldLength = length;
+					line = swap;
+					lineSize = swapSize;
+					break;
+				}
+
+				case EXPORT_BINFILE:
+				case EXPORT_CRYPTEDBINFILE:
+					if (exportAppendHex(ctx, line, length))
+					{
+						fprintf(stderr, "Invalid hexadecimal data found in '%s'.\n", name);
+						rc = 1;
+						state = EXPORT_END;
+					}
+					break;
+
+				default:
+					break;
+			}
+			continue;
+		}
+
+		if (marker == EXPORT_BETWEEN || marker == EXPORT_END)
+		{
+			heldLength = -1;
+			state = marker;
+			continue;
+		}
+
+		if (state == EXPORT_CFGFILE || state == EXPORT_BINFILE || state == EXPORT_CRYPTEDBINFILE)
+		{
+			fprintf(stderr, "Missing end of file marker in '%s'.\n", name);
+			rc = 1;
+			break;
+		}
+
+		exportAppendName(ctx, partName, partNameSize);
+		heldLength = -1;
+		state = marker;
+	}
+
+	if (rc == 0 && ferror(input))
+	{
+		fprintf(stderr, "Error %d reading input data.\n", errno);
+		rc = 1;
+	}
+
+	if (rc == 0)
+	{
+		exportFlush(ctx);
+		*crcValue = ~ctx->crc;
+	}
+
+	free(line);
+	free(held);
+	free(ctx);
+	return rc;
+}
+
+static int exportChecksumFile(const char *name, uint32_t *crcValue)
+{
+	struct stat		st;
+	FILE *			input;
+	int				rc;
+
+	if (stat(name, &st) == -1)
+	{
+		fprintf(stderr, "Error %d getting attributes of file '%s'.\n", errno, name);
+		return 1;
+	}
+
+	if (S_ISDIR(st.st_mode)) return exportChecksumFolder(name, crcValue);
+
+	if ((input = fopen(name, "r")) == NULL)
+	{
+		fprintf(stderr, "Error %d opening file '%s'.\n", errno, name);
+		return 1;
+	}
+	rc = exportChecksumStream(input, name, crcValue);
+	fclose(input);
+
+	return rc;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [ -j <threads> ] [ -t <threshold> ] [ <file> ... ]\n", name);
+	fprintf(stderr, "       %s -e [ <export> | <folder> ... ]\n\n", name);
+	fprintf(stderr, "Computes the CRC32 value of each specified file or of the data from STDIN, if no file was specified.\n\n");
+	fprintf(stderr, "Files are mapped to memory and files with at least <threshold> bytes (default %u, a suffix\n", PARALLEL_THRESHOLD);
+	fprintf(stderr, "of 'K' or 'M' is accepted) are split into chunks, which are processed by up to <threads> threads\n");
+	fprintf(stderr, "(default is the number of online CPUs, use '-j 1' to disable this mode).\n\n");
+	fprintf(stderr, "With '-e' the checksum of a FRITZ!OS settings export (or of a folder created by 'decompose') is\n");
+	fprintf(stderr, "computed, like it's expected on the line with the 'END OF EXPORT' marker.\n");
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t		crcValue;
+	long			threads = 0;
+	size_t			threshold = PARALLEL_THRESHOLD;
+	char *			end;
+	int				exportMode = 0;
+	int				opt;
+	int				rc = 0;
+
+	while ((opt = getopt(argc, argv, "ej:t:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'e':
+				exportMode = 1;
+				break;
+
+			case 'j':
+				threads = strtol(optarg, &end, 10);
+				if (*end || threads < 1)
+				{
+					fprintf(stderr, "Invalid number of threads '%s' specified.\n", optarg);
+					return 1;
+				}
+				break;
+
+			case 't':
+				threshold = strtoul(optarg, &end, 0);
+				if (*end == 'K' || *end == 'k') threshold *= 1024, end++;
+				else if (*end == 'M' || *end == 'm') threshold *= 1024 * 1024, end++;
+				if (*end)
+				{
+					fprintf(stderr, "Invalid threshold value '%s' specified.\n", optarg);
+					return 1;
+				}
+				break;
+
+			case 'h':
+				usage(argv[0]);
+				return 0;
+
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+
+	crc32Select();
+
+	if (exportMode)
+	{
+		if (optind >= argc)
+		{
+			if (exportChecksumStream(stdin, "STDIN", &crcValue) != 0) return 1;
+			printf("%08X\n", crcValue);
+			return 0;
+		}
+
+		for (; optind < argc; optind++)
+		{
+			if (exportChecksumFile(argv[optind], &crcValue) != 0)
+			{
+				rc = 1;
+				continue;
+			}
+			printf("%08X\n", crcValue);
+		}
+
+		return rc;
+	}
+
+	if (optind >= argc)
+	{
+		crcValue = crc32Stream(0);
+		printf("%08X\n", crcValue);
+		return 0;
+	}
+
+	if (threads == 0)
+	{
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (threads < 1) threads = 1;
+	}
+	if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+	for (; optind < argc; optind++)
+	{
+		if (crc32File(argv[optind], threads, threshold, &crcValue) != 0)
+		{
+			rc = 1;
+			continue;
+		}
+		printf("%08X\n", crcValue);
+	}
+
+	return rc;
+}
+
+#endif
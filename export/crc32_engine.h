@@ -0,0 +1,326 @@
+/* CRC32 engine (LE polynomial 0xEDB88320) with runtime selection of the fastest implementation */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * All functions work on the inverted CRC value, the caller has to apply the initial value (all ones) and the
+ * final XOR. crc32Select() has to be called once, before crc32Update() is used (and before any threads are
+ * started).
+ *
+ * The functions are static, each program including this file gets its own copy.
+ */
+#ifndef CRC32_ENGINE_H
+#define CRC32_ENGINE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define CRC32_POLYNOM			0xEDB88320
+
+#ifndef MAKECRCH
+
+#include "crc32_table.h"
+
+/* portable implementation, works on the inverted CRC value like all others */
+static uint32_t crc32Bytes(uint32_t crc, const uint8_t *data, size_t size)
+{
+	while (size--) crc = (crc >> 8) ^ crc32Table[0][(crc ^ *(data++)) & 0xFF];
+	return crc;
+}
+
+static uint32_t crc32Slicing(uint32_t crc, const uint8_t *data, size_t size)
+{
+	while (size >= 16)
+	{
+		uint32_t	w0 = crc ^ ((uint32_t) data[0] | (uint32_t) data[1] << 8 | (uint32_t) data[2] << 16 | (uint32_t) data[3] << 24);
+
+		crc = crc32Table[15][w0 & 0xFF] ^ crc32Table[14][(w0 >> 8) & 0xFF] ^ crc32Table[13][(w0 >> 16) & 0xFF] ^ crc32Table[12][w0 >> 24] ^
+			crc32Table[11][data[4]] ^ crc32Table[10][data[5]] ^ crc32Table[9][data[6]] ^ crc32Table[8][data[7]] ^
+			crc32Table[7][data[8]] ^ crc32Table[6][data[9]] ^ crc32Table[5][data[10]] ^ crc32Table[4][data[11]] ^
+			crc32Table[3][data[12]] ^ crc32Table[2][data[13]] ^ crc32Table[1][data[14]] ^ crc32Table[0][data[15]];
+		data += 16;
+		size -= 16;
+	}
+
+	if (size >= 8)
+	{
+		uint32_t	w0 = crc ^ ((uint32_t) data[0] | (uint32_t) data[1] << 8 | (uint32_t) data[2] << 16 | (uint32_t) data[3] << 24);
+
+		crc = crc32Table[7][w0 & 0xFF] ^ crc32Table[6][(w0 >> 8) & 0xFF] ^ crc32Table[5][(w0 >> 16) & 0xFF] ^ crc32Table[4][w0 >> 24] ^
+			crc32Table[3][data[4]] ^ crc32Table[2][data[5]] ^ crc32Table[1][data[6]] ^ crc32Table[0][data[7]];
+		data += 8;
+		size -= 8;
+	}
+
+	return crc32Bytes(crc, data, size);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define CRC32_SIMD_MINIMUM		64
+
+/*
+ * folding with carry-less multiplication, the constants are the ones from Intel's paper "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction" for the reflected polynomial - only multiples of 16 bytes and
+ * at least 64 bytes are processed here
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32Folding(uint32_t crc, const uint8_t *data, size_t size)
+{
+	static const uint64_t	k1k2[] __attribute__((aligned(16))) = { 0x0154442bd4, 0x01c6e41596 };
+	static const uint64_t	k3k4[] __attribute__((aligned(16))) = { 0x01751997d0, 0x00ccaa009e };
+	static const uint64_t	k5k0[] __attribute__((aligned(16))) = { 0x0163cd6124, 0x0000000000 };
+	static const uint64_t	poly[] __attribute__((aligned(16))) = { 0x01db710641, 0x01f7011641 };
+	__m128i					x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+	x1 = _mm_loadu_si128((__m128i *) (data + 0x00));
+	x2 = _mm_loadu_si128((__m128i *) (data + 0x10));
+	x3 = _mm_loadu_si128((__m128i *) (data + 0x20));
+	x4 = _mm_loadu_si128((__m128i *) (data + 0x30));
+
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc));
+	x0 = _mm_load_si128((__m128i *) k1k2);
+
+	data += 64;
+	size -= 64;
+
+	/* fold 512 bits per round */
+	while (size >= 64)
+	{
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+		y5 = _mm_loadu_si128((__m128i *) (data + 0x00));
+		y6 = _mm_loadu_si128((__m128i *) (data + 0x10));
+		y7 = _mm_loadu_si128((__m128i *) (data + 0x20));
+		y8 = _mm_loadu_si128((__m128i *) (data + 0x30));
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+		data += 64;
+		size -= 64;
+	}
+
+	/* fold into 128 bits */
+	x0 = _mm_load_si128((__m128i *) k3k4);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	/* single 128 bit blocks */
+	while (size >= 16)
+	{
+		x2 = _mm_loadu_si128((__m128i *) data);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+		data += 16;
+		size -= 16;
+	}
+
+	/* fold 128 bits to 64 bits */
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+
+	x0 = _mm_loadl_epi64((__m128i *) k5k0);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits */
+	x0 = _mm_load_si128((__m128i *) poly);
+
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return (uint32_t) _mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32Accelerated(uint32_t crc, const uint8_t *data, size_t size)
+{
+	if (size >= CRC32_SIMD_MINIMUM)
+	{
+		size_t		blocks = size & ~((size_t) 15);
+
+		crc = crc32Folding(crc, data, blocks);
+		data += blocks;
+		size -= blocks;
+	}
+
+	return crc32Slicing(crc, data, size);
+}
+
+static int crc32AccelerationAvailable(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"));
+}
+
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32				(1 << 7)
+#endif
+
+/* the CRC32 instructions (not CRC32C) use the same polynomial and work on the inverted value, too */
+__attribute__((target("+crc")))
+static uint32_t crc32Accelerated(uint32_t crc, const uint8_t *data, size_t size)
+{
+	while (size && ((uintptr_t) data & 7))
+	{
+		crc = __crc32b(crc, *(data++));
+		size--;
+	}
+
+	while (size >= 32)
+	{
+		uint64_t	words[4];
+
+		memcpy(words, data, sizeof(words));
+		crc = __crc32d(crc, words[0]);
+		crc = __crc32d(crc, words[1]);
+		crc = __crc32d(crc, words[2]);
+		crc = __crc32d(crc, words[3]);
+		data += 32;
+		size -= 32;
+	}
+
+	while (size >= 8)
+	{
+		uint64_t	word;
+
+		memcpy(&word, data, sizeof(word));
+		crc = __crc32d(crc, word);
+		data += 8;
+		size -= 8;
+	}
+
+	while (size--) crc = __crc32b(crc, *(data++));
+
+	return crc;
+}
+
+static int crc32AccelerationAvailable(void)
+{
+	return ((getauxval(AT_HWCAP) & HWCAP_CRC32) != 0);
+}
+
+#else
+
+#define crc32Accelerated		crc32Slicing
+
+static int crc32AccelerationAvailable(void)
+{
+	return 0;
+}
+
+#endif
+
+typedef uint32_t (*crc32Function)(uint32_t crc, const uint8_t *data, size_t size);
+
+static crc32Function		crc32Implementation = crc32Slicing;
+
+/* select the implementation once, before any threads are started */
+static void crc32Select(void)
+{
+	if (crc32AccelerationAvailable()) crc32Implementation = crc32Accelerated;
+}
+
+static uint32_t crc32Update(uint32_t crc, const void *data, size_t size)
+{
+	return crc32Implementation(crc, (const uint8_t *) data, size);
+}
+
+/*
+ * combine the CRC values of two adjacent blocks, the second one with the specified length - the usual
+ * approach with 32x32 matrices over GF(2) to apply 'length' zero bytes to the first CRC value, like it's
+ * done by zlib
+ */
+static uint32_t gf2MatrixTimes(const uint32_t *matrix, uint32_t vector)
+{
+	uint32_t		sum = 0;
+
+	while (vector)
+	{
+		if (vector & 1) sum ^= *matrix;
+		vector >>= 1;
+		matrix++;
+	}
+
+	return sum;
+}
+
+static void gf2MatrixSquare(uint32_t *square, const uint32_t *matrix)
+{
+	int				n;
+
+	for (n = 0; n < 32; n++) square[n] = gf2MatrixTimes(matrix, matrix[n]);
+}
+
+static uint32_t crc32Combine(uint32_t crc1, uint32_t crc2, uint64_t length2)
+{
+	uint32_t		even[32];
+	uint32_t		odd[32];
+	uint32_t		row = 1;
+	int				n;
+
+	if (length2 == 0) return crc1;
+
+	/* operator for one zero bit */
+	odd[0] = CRC32_POLYNOM;
+	for (n = 1; n < 32; n++)
+	{
+		odd[n] = row;
+		row <<= 1;
+	}
+
+	gf2MatrixSquare(even, odd);		/* two zero bits */
+	gf2MatrixSquare(odd, even);		/* four zero bits */
+
+	/* apply length2 zero bytes to crc1, the first square yields the operator for one zero byte */
+	do
+	{
+		gf2MatrixSquare(even, odd);
+		if (length2 & 1) crc1 = gf2MatrixTimes(even, crc1);
+		length2 >>= 1;
+		if (length2 == 0) break;
+
+		gf2MatrixSquare(odd, even);
+		if (length2 & 1) crc1 = gf2MatrixTimes(odd, crc1);
+		length2 >>= 1;
+	} while (length2 != 0);
+
+	return crc1 ^ crc2;
+}
+#endif
+
+#endif
@@ -0,0 +1,491 @@
+/* canonicalized data of FRITZ!OS settings exports for the checksum computation */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef EXPORT_CHECKSUM_H
+#define EXPORT_CHECKSUM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "crc32_engine.h"
+
+#define EXPORT_BUFFER_SIZE		(64 * 1024)
+#define EXPORT_CACHE_NAME		"crccache"
+
+/*
+ * checksum of a FRITZ!OS settings export - the data is canonicalized like it's done by the 'checksum' script:
+ *
+ * - header lines (with the exception of lines starting with '****') without their first '=' and with a NUL
+ *   character appended
+ * - each part contributes its name with a NUL character appended, followed by its content
+ * - CFGFILE content has '\\' replaced by '\' and its last line is ignored
+ * - BINFILE and CRYPTEDBINFILE content is decoded from hexadecimal presentation
+ *
+ * The input may be an export file (or STDIN) or a folder created by the 'decompose' script.
+ *
+ * For a folder, the CRC value and the length of the data for the header and for each part are stored in the
+ * file 'crccache' there, together with size, inode number, modification and change time of the file it was
+ * computed from. Later calls compute the data of changed files only and the final value is combined from the
+ * cached values. Like with git's index, an entry isn't trusted, if its file was modified within the same
+ * timestamp tick as the cache was written (or later) - it could have been changed after it was read.
+ */
+struct exportChecksum
+{
+	uint32_t		crc;
+	uint64_t		length;
+	size_t			used;
+	uint8_t			buffer[EXPORT_BUFFER_SIZE];
+};
+
+static void exportReset(struct exportChecksum *ctx)
+{
+	ctx->crc = ~((uint32_t) 0);
+	ctx->length = 0;
+	ctx->used = 0;
+}
+
+static void exportFlush(struct exportChecksum *ctx)
+{
+	ctx->crc = crc32Update(ctx->crc, ctx->buffer, ctx->used);
+	ctx->length += ctx->used;
+	ctx->used = 0;
+}
+
+static void exportAppend(struct exportChecksum *ctx, const void *data, size_t size)
+{
+	if (ctx->used + size > sizeof(ctx->buffer))
+	{
+		exportFlush(ctx);
+		if (size > sizeof(ctx->buffer))
+		{
+			ctx->crc = crc32Update(ctx->crc, data, size);
+			ctx->length += size;
+			return;
+		}
+	}
+	memcpy(ctx->buffer + ctx->used, data, size);
+	ctx->used += size;
+}
+
+static void exportAppendByte(struct exportChecksum *ctx, uint8_t byte)
+{
+	if (ctx->used == sizeof(ctx->buffer)) exportFlush(ctx);
+	ctx->buffer[ctx->used++] = byte;
+}
+
+static size_t exportLineLength(const char *line, size_t size)
+{
+	if (size > 0 && line[size - 1] == '\n') size--;
+	return size;
+}
+
+static void exportAppendHeader(struct exportChecksum *ctx, const char *line, size_t size)
+{
+	const char *	equal;
+
+	if (size >= 4 && memcmp(line, "****", 4) == 0) return;
+
+	size = exportLineLength(line, size);
+	if ((equal = memchr(line, '=', size)) != NULL)
+	{
+		exportAppend(ctx, line, equal - line);
+		exportAppend(ctx, equal + 1, size - (equal - line) - 1);
+	}
+	else
+		exportAppend(ctx, line, size);
+	exportAppendByte(ctx, 0);
+}
+
+static void exportAppendName(struct exportChecksum *ctx, const char *name, size_t size)
+{
+	exportAppend(ctx, name, size);
+	exportAppendByte(ctx, 0);
+}
+
+static void exportAppendConfig(struct exportChecksum *ctx, const char *line, size_t size)
+{
+	const char *	start = line;
+	const char *	end = line + size;
+
+	while (line < end)
+	{
+		const char *	backslash = memchr(line, '\\', end - line);
+
+		if (backslash == NULL || backslash + 1 == end) break;
+		if (backslash[1] == '\\')
+		{
+			exportAppend(ctx, start, backslash + 1 - start);
+			start = backslash + 2;
+		}
+		line = backslash + 2;
+	}
+	exportAppend(ctx, start, end - start);
+}
+
+static int exportHexValue(char digit)
+{
+	if (digit >= '0' && digit <= '9') return digit - '0';
+	if (digit >= 'A' && digit <= 'F') return digit - 'A' + 10;
+	if (digit >= 'a' && digit <= 'f') return digit - 'a' + 10;
+	return -1;
+}
+
+static int exportAppendHex(struct exportChecksum *ctx, const char *line, size_t size)
+{
+	size = exportLineLength(line, size);
+	while (size > 0 && (line[size - 1] == ' ' || line[size - 1] == '\r')) size--;
+
+	if (size % 2) return 1;
+	for (; size > 0; line += 2, size -= 2)
+	{
+		int		high = exportHexValue(line[0]);
+		int		low = exportHexValue(line[1]);
+
+		if (high < 0 || low < 0) return 1;
+		exportAppendByte(ctx, (uint8_t) ((high << 4) | low));
+	}
+
+	return 0;
+}
+
+/* path names of files in the folder */
+static int exportPath(char *path, const char *folder, const char *name)
+{
+	if (snprintf(path, PATH_MAX, "%s/%s", folder, name) >= PATH_MAX)
+	{
+		fprintf(stderr, "Path name for file '%s' is too long.\n", name);
+		*path = 0;
+		return 1;
+	}
+
+	return 0;
+}
+
+/* the same data from a folder, which was created by the 'decompose' script */
+static int exportChecksumPart(struct exportChecksum *ctx, const char *folder, char type, const char *name)
+{
+	char			partName[PATH_MAX];
+	char			path[PATH_MAX];
+	FILE *			part;
+	char *			line = NULL;
+	size_t			lineSize = 0;
+	ssize_t			length;
+	int				rc = 0;
+
+	if (snprintf(partName, sizeof(partName), "parts/%s", name) >= (int) sizeof(partName) || exportPath(path, folder, partName)) return 1;
+
+	if ((part = fopen(path, "r")) == NULL)
+	{
+		fprintf(stderr, "Error %d opening file '%s'.\n", errno, path);
+		return 1;
+	}
+
+	exportAppendName(ctx, name, strlen(name));
+
+	if (type == 'b')
+	{
+		size_t		readBytes;
+
+		exportFlush(ctx);
+		while ((readBytes = fread(ctx->buffer, 1, sizeof(ctx->buffer), part)) > 0)
+		{
+			ctx->used = readBytes;
+			exportFlush(ctx);
+		}
+	}
+	else
+	{
+		char *		held = NULL;
+		size_t		heldSize = 0;
+		ssize_t		heldLength = -1;
+
+		while ((length = getline(&line, &lineSize, part)) != -1)
+		{
+			if (type == 'c')
+			{
+				char *		swap = held;
+				size_t		swapSize = heldSize;
+
+				if (heldLength != -1) exportAppendConfig(ctx, held, heldLength);
+				held = line;
+				heldSize = lineSize;
+				heldLength = length;
+				line = swap;
+				lineSize = swapSize;
+			}
+			else if (exportAppendHex(ctx, line, length))
+			{
+				fprintf(stderr, "Invalid hexadecimal data found in '%s'.\n", path);
+				rc = 1;
+				break;
+			}
+		}
+		free(held);
+	}
+
+	if (rc == 0 && ferror(part))
+	{
+		fprintf(stderr, "Error %d reading file '%s'.\n", errno, path);
+		rc = 1;
+	}
+
+	free(line);
+	fclose(part);
+	return rc;
+}
+
+/* the data of the header or of a part, as stored in the cache */
+struct exportSegment
+{
+	char			type;
+	char			name[NAME_MAX + 1];
+	intmax_t		size;
+	intmax_t		seconds;
+	long			nanoseconds;
+	uintmax_t		inode;
+	intmax_t		changedSeconds;
+	long			changedNanoseconds;
+	uint32_t		crc;
+	uint64_t		length;
+};
+
+static int exportChecksumHeader(struct exportChecksum *ctx, const char *folder)
+{
+	char			path[PATH_MAX];
+	FILE *			input;
+	char *			line = NULL;
+	size_t			lineSize = 0;
+	ssize_t			length;
+
+	if (exportPath(path, folder, "header")) return 1;
+	if ((input = fopen(path, "r")) == NULL)
+	{
+		fprintf(stderr, "Error %d opening file '%s'.\n", errno, path);
+		return 1;
+	}
+	while ((length = getline(&line, &lineSize, input)) != -1) exportAppendHeader(ctx, line, length);
+	fclose(input);
+	free(line);
+
+	return 0;
+}
+
+/* uses the cached values, if the attributes of the file are unchanged and it's older than the cache */
+static int exportChecksumSegment(struct exportChecksum *ctx, const char *folder, struct exportSegment *segment, const struct exportSegment *cache, size_t cached, const struct timespec *cacheTime, int *changed)
+{
+	char			partName[PATH_MAX];
+	char			path[PATH_MAX];
+	struct stat		st;
+	size_t			i;
+	int				rc;
+
+	snprintf(partName, sizeof(partName), (segment->type == 'h' ? "%s" : "parts/%s"), segment->name);
+	if (exportPath(path, folder, partName)) return 1;
+
+	if (stat(path, &st) == -1)
+	{
+		fprintf(stderr, "Error %d getting attributes of file '%s'.\n", errno, path);
+		return 1;
+	}
+	segment->size = st.st_size;
+	segment->seconds = st.st_mtim.tv_sec;
+	segment->nanoseconds = st.st_mtim.tv_nsec;
+	segment->inode = st.st_ino;
+	segment->changedSeconds = st.st_ctim.tv_sec;
+	segment->changedNanoseconds = st.st_ctim.tv_nsec;
+
+	/* a racy entry - modified in the same tick as the cache was written - has to be computed again */
+	if (segment->seconds > cacheTime->tv_sec || (segment->seconds == cacheTime->tv_sec && segment->nanoseconds >= cacheTime->tv_nsec)) cached = 0;
+
+	for (i = 0; i < cached; i++)
+	{
+		if (cache[i].type == segment->type && strcmp(cache[i].name, segment->name) == 0 && cache[i].size == segment->size &&
+			cache[i].seconds == segment->seconds && cache[i].nanoseconds == segment->nanoseconds && cache[i].inode == segment->inode &&
+			cache[i].changedSeconds == segment->changedSeconds && cache[i].changedNanoseconds == segment->changedNanoseconds)
+		{
+			segment->crc = cache[i].crc;
+			segment->length = cache[i].length;
+			return 0;
+		}
+	}
+
+	exportReset(ctx);
+	if (segment->type == 'h')
+		rc = exportChecksumHeader(ctx, folder);
+	else
+		rc = exportChecksumPart(ctx, folder, segment->type, segment->name);
+	if (rc) return rc;
+	exportFlush(ctx);
+
+	segment->crc = ~ctx->crc;
+	segment->length = ctx->length;
+	*changed = 1;
+
+	return 0;
+}
+
+static size_t exportReadCache(const char *folder, struct exportSegment **cache, struct timespec *cacheTime)
+{
+	char			path[PATH_MAX];
+	FILE *			input;
+	char *			line = NULL;
+	size_t			lineSize = 0;
+	size_t			count = 0;
+	size_t			allocated = 0;
+	struct stat		st;
+
+	*cache = NULL;
+	cacheTime->tv_sec = 0;
+	cacheTime->tv_nsec = 0;
+	if (exportPath(path, folder, EXPORT_CACHE_NAME) || (input = fopen(path, "r")) == NULL) return 0;
+	if (fstat(fileno(input), &st) == 0) *cacheTime = st.st_mtim;
+
+	while (getline(&line, &lineSize, input) != -1)
+	{
+		struct exportSegment	segment;
+
+		if (*line == '#') continue;
+		if (sscanf(line, "%c %255s %jd %jd.%ld %ju %jd.%ld %" SCNx32 " %" SCNu64, &segment.type, segment.name, &segment.size,
+			&segment.seconds, &segment.nanoseconds, &segment.inode, &segment.changedSeconds, &segment.changedNanoseconds,
+			&segment.crc, &segment.length) != 10) continue;
+
+		if (count == allocated)
+		{
+			struct exportSegment *	larger;
+
+			allocated = (allocated ? allocated * 2 : 64);
+			if ((larger = realloc(*cache, allocated * sizeof(struct exportSegment))) == NULL) break;
+			*cache = larger;
+		}
+		(*cache)[count++] = segment;
+	}
+
+	fclose(input);
+	free(line);
+	return count;
+}
+
+static int exportWriteCache(const char *folder, const struct exportSegment *segments, size_t count)
+{
+	char			path[PATH_MAX];
+	char			temporary[PATH_MAX];
+	FILE *			output;
+	size_t			i;
+
+	if (exportPath(path, folder, EXPORT_CACHE_NAME)) return 1;
+	if (snprintf(temporary, sizeof(temporary), "%s.%d", path, (int) getpid()) >= (int) sizeof(temporary)) return 1;
+
+	if ((output = fopen(temporary, "w")) == NULL)
+	{
+		fprintf(stderr, "Error %d creating file '%s'.\n", errno, temporary);
+		return 1;
+	}
+
+	fprintf(output, "# type name size modified inode changed crc length\n");
+	for (i = 0; i < count; i++)
+	{
+		fprintf(output, "%c %s %jd %jd.%09ld %ju %jd.%09ld %08" PRIX32 " %" PRIu64 "\n", segments[i].type, segments[i].name, segments[i].size,
+			segments[i].seconds, segments[i].nanoseconds, segments[i].inode, segments[i].changedSeconds, segments[i].changedNanoseconds,
+			segments[i].crc, segments[i].length);
+	}
+
+	if (ferror(output) | fclose(output) || rename(temporary, path) == -1)
+	{
+		fprintf(stderr, "Error %d writing file '%s'.\n", errno, path);
+		unlink(temporary);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* the segments are combined with the cached (or computed) values, the cache is updated on changes */
+static int exportChecksumFolder(const char *folder, uint32_t *crcValue)
+{
+	struct exportChecksum *	ctx;
+	struct exportSegment *	segments;
+	struct exportSegment *	cache;
+	struct timespec			cacheTime;
+	size_t					cached;
+	size_t					count = 1;
+	size_t					allocated = 64;
+	char					path[PATH_MAX];
+	FILE *					input;
+	char *					line = NULL;
+	size_t					lineSize = 0;
+	uint32_t				crc = 0;
+	int						changed = 0;
+	int						rc = 0;
+	size_t					i;
+
+	if ((ctx = malloc(sizeof(struct exportChecksum))) == NULL || (segments = malloc(allocated * sizeof(struct exportSegment))) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the checksum buffer.\n", errno);
+		free(ctx);
+		return 1;
+	}
+
+	segments[0].type = 'h';
+	strcpy(segments[0].name, "header");
+
+	if (exportPath(path, folder, "filelist") || (input = fopen(path, "r")) == NULL)
+	{
+		if (*path) fprintf(stderr, "Error %d opening file '%s'.\n", errno, path);
+		free(segments);
+		free(ctx);
+		return 1;
+	}
+	while (getline(&line, &lineSize, input) != -1)
+	{
+		if (count == allocated)
+		{
+			struct exportSegment *	larger;
+
+			allocated *= 2;
+			if ((larger = realloc(segments, allocated * sizeof(struct exportSegment))) == NULL)
+			{
+				fprintf(stderr, "Error %d allocating memory for the file list.\n", errno);
+				rc = 1;
+				break;
+			}
+			segments = larger;
+		}
+
+		if (sscanf(line, "%c %*u %*u %255s", &segments[count].type, segments[count].name) != 2 ||
+			(segments[count].type != 'c' && segments[count].type != 'b' && segments[count].type != 'B'))
+		{
+			fprintf(stderr, "Invalid line found in '%s'.\n", path);
+			rc = 1;
+			break;
+		}
+		count++;
+	}
+	fclose(input);
+	free(line);
+
+	cached = exportReadCache(folder, &cache, &cacheTime);
+
+	for (i = 0; rc == 0 && i < count; i++)
+	{
+		rc = exportChecksumSegment(ctx, folder, &segments[i], cache, cached, &cacheTime, &changed);
+		if (rc == 0) crc = crc32Combine(crc, segments[i].crc, segments[i].length);
+	}
+
+	if (rc == 0)
+	{
+		*crcValue = crc;
+		if (changed || cached != count) exportWriteCache(folder, segments, count);
+	}
+
+	free(cache);
+	free(segments);
+	free(ctx);
+	return rc;
+}
+
+#endif
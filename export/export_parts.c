@@ -0,0 +1,652 @@
+/* split a FRITZ!OS settings export into its parts and build it again from them */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * This is a native replacement for the 'decompose' and 'compose' scripts, which creates (and uses) the
+ * same folder structure:
+ *
+ * - 'input' is a copy of the processed export file
+ * - 'header' contains all lines in front of the first part
+ * - 'filelist' contains a line "<type> <first_line> <last_line> <name>" for each part, where the type is
+ *   'c' for a CFGFILE, 'b' for a BINFILE and 'B' for a CRYPTEDBINFILE
+ * - 'parts' contains a file for each part, BINFILE content is decoded from its hexadecimal presentation
+ * - 'tail' contains the checksum from the end of the export as "chksum=<value>"
+ *
+ * 'decompose' reads the export from the specified file or from STDIN, creates a new folder and writes its
+ * name to STDOUT. The CRC values and lengths of the checksummed data for the header and all parts are
+ * stored in the file 'crccache' there, see 'export_checksum.h'. 'compose' writes the export to STDOUT (and
+ * to the file 'output' in the folder).
+ *
+ * The results are byte-identical to the scripts, with one exception: the content of a CRYPTEDBINFILE is
+ * kept in hexadecimal presentation by 'decompose' and it's written back unchanged by 'compose' - the
+ * script encoded it again and the result was unusable.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "export_checksum.h"
+
+#define READ_BUFFER_SIZE		(256 * 1024)
+#define FILE_BUFFER_SIZE		(256 * 1024)
+#define HEX_BYTES_PER_LINE		40
+
+/* input data - mapped from a file or read from a pipe */
+struct inputData
+{
+	uint8_t *		data;
+	size_t			size;
+	int				mapped;
+};
+
+static int loadInput(const char *name, struct inputData *input)
+{
+	struct stat		st;
+	ssize_t			readBytes;
+	size_t			allocated = 0;
+	int				fd = 0;
+
+	memset(input, 0, sizeof(struct inputData));
+
+	if (name != NULL && (fd = open(name, O_RDONLY)) == -1)
+	{
+		fprintf(stderr, "Error %d opening file '%s'.\n", errno, name);
+		return 1;
+	}
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		if ((input->data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED)
+		{
+			input->size = st.st_size;
+			input->mapped = 1;
+			if (fd) close(fd);
+			return 0;
+		}
+		input->data = NULL;
+	}
+
+	while (1)
+	{
+		if (input->size == allocated)
+		{
+			uint8_t *	data;
+
+			allocated = (allocated ? allocated * 2 : READ_BUFFER_SIZE);
+			if ((data = realloc(input->data, allocated)) == NULL)
+			{
+				fprintf(stderr, "Error %d allocating memory for the input data.\n", errno);
+				free(input->data);
+				if (fd) close(fd);
+				return 1;
+			}
+			input->data = data;
+		}
+
+		if ((readBytes = read(fd, input->data + input->size, allocated - input->size)) == 0) break;
+		if (readBytes == -1)
+		{
+			if (errno == EINTR) continue;
+			fprintf(stderr, "Error %d reading input data.\n", errno);
+			free(input->data);
+			if (fd) close(fd);
+			return 1;
+		}
+		input->size += readBytes;
+	}
+
+	if (fd) close(fd);
+	return 0;
+}
+
+static void releaseInput(struct inputData *input)
+{
+	if (input->mapped)
+		munmap(input->data, input->size);
+	else
+		free(input->data);
+}
+
+static FILE * createFile(const char *folder, const char *name, const char *mode)
+{
+	char			path[PATH_MAX];
+	FILE *			file;
+
+	if (snprintf(path, sizeof(path), "%s/%s", folder, name) >= (int) sizeof(path))
+	{
+		fprintf(stderr, "Path name for file '%s' is too long.\n", name);
+		return NULL;
+	}
+
+	if ((file = fopen(path, mode)) == NULL)
+	{
+		fprintf(stderr, "Error %d opening file '%s'.\n", errno, path);
+		return NULL;
+	}
+	setvbuf(file, NULL, _IOFBF, FILE_BUFFER_SIZE);
+
+	return file;
+}
+
+static int closeFile(FILE *file, const char *name)
+{
+	if (ferror(file) | fclose(file))
+	{
+		fprintf(stderr, "Error %d writing file '%s'.\n", errno, name);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int isHexDigit(uint8_t digit)
+{
+	return ((digit >= '0' && digit <= '9') || (digit >= 'A' && digit <= 'F') || (digit >= 'a' && digit <= 'f'));
+}
+
+static uint8_t hexValue(uint8_t digit)
+{
+	return (digit <= '9' ? digit - '0' : (digit & ~0x20) - 'A' + 10);
+}
+
+/*
+ * decode one line of hexadecimal data - blocks of 32 valid digits are converted with SIMD instructions, if
+ * they're available, anything else is handled like the 'echo -e "\xNN"' calls of the script did it:
+ * a single digit is a value on its own and invalid data is copied unchanged
+ */
+static size_t decodeHexLine(const uint8_t *line, size_t size, uint8_t *output)
+{
+	uint8_t *		start = output;
+
+#if defined(__SSE2__)
+	while (size >= 32)
+	{
+		__m128i		lo = _mm_loadu_si128((const __m128i *) line);
+		__m128i		hi = _mm_loadu_si128((const __m128i *) (line + 16));
+		__m128i		digits[2] = { lo, hi };
+		__m128i		values[2];
+		int			valid = 0xFFFF;
+		int			i;
+
+		for (i = 0; i < 2; i++)
+		{
+			__m128i		v = digits[i];
+			__m128i		letters = _mm_and_si128(v, _mm_set1_epi8((char) 0xDF));
+			__m128i		isDigit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+			__m128i		isLetter = _mm_and_si128(_mm_cmpgt_epi8(letters, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(letters, _mm_set1_epi8('F' + 1)));
+
+			valid &= _mm_movemask_epi8(_mm_or_si128(isDigit, isLetter));
+			values[i] = _mm_or_si128(_mm_and_si128(isDigit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+				_mm_and_si128(isLetter, _mm_sub_epi8(letters, _mm_set1_epi8('A' - 10))));
+			/* high nibble is the even byte, low nibble the odd one */
+			values[i] = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(values[i], _mm_set1_epi16(0x00FF)), 4), _mm_srli_epi16(values[i], 8));
+		}
+		if (valid != 0xFFFF) break;
+
+		_mm_storeu_si128((__m128i *) output, _mm_packus_epi16(values[0], values[1]));
+		output += 16;
+		line += 32;
+		size -= 32;
+	}
+#endif
+
+	while (size > 0)
+	{
+		if (!isHexDigit(line[0]))
+		{
+			*(output++) = '\\';
+			*(output++) = 'x';
+			*(output++) = line[0];
+			if (size > 1) *(output++) = line[1];
+		}
+		else if (size > 1 && isHexDigit(line[1]))
+			*(output++) = (hexValue(line[0]) << 4) | hexValue(line[1]);
+		else
+		{
+			*(output++) = hexValue(line[0]);
+			if (size > 1) *(output++) = line[1];
+		}
+
+		if (size < 2) break;
+		line += 2;
+		size -= 2;
+	}
+
+	return output - start;
+}
+
+static const char	hexDigits[] = "0123456789ABCDEF";
+
+/* encode data with up to 40 bytes to a line of uppercase hexadecimal digits, including the newline */
+static size_t encodeHexLine(const uint8_t *data, size_t size, char *output)
+{
+	char *			start = output;
+
+#if defined(__SSE2__)
+	while (size >= 16)
+	{
+		__m128i		v = _mm_loadu_si128((const __m128i *) data);
+		__m128i		mask = _mm_set1_epi8(0x0F);
+		__m128i		hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+		__m128i		lo = _mm_and_si128(v, mask);
+		__m128i		first = _mm_unpacklo_epi8(hi, lo);
+		__m128i		second = _mm_unpackhi_epi8(hi, lo);
+		__m128i		nine = _mm_set1_epi8(9);
+		__m128i		offset = _mm_set1_epi8('A' - '9' - 1);
+
+		first = _mm_add_epi8(_mm_add_epi8(first, _mm_set1_epi8('0')), _mm_and_si128(_mm_cmpgt_epi8(first, nine), offset));
+		second = _mm_add_epi8(_mm_add_epi8(second, _mm_set1_epi8('0')), _mm_and_si128(_mm_cmpgt_epi8(second, nine), offset));
+		_mm_storeu_si128((__m128i *) output, first);
+		_mm_storeu_si128((__m128i *) (output + 16), second);
+		output += 32;
+		data += 16;
+		size -= 16;
+	}
+#endif
+
+	while (size--)
+	{
+		*(output++) = hexDigits[*data >> 4];
+		*(output++) = hexDigits[*(data++) & 0x0F];
+	}
+	*(output++) = '\n';
+
+	return output - start;
+}
+
+/* the part types, their markers and the character used in the file list */
+static const struct
+{
+	const char *	marker;
+	char			type;
+}					partTypes[] = {
+	{ "CFGFILE:", 'c' },
+	{ "CRYPTEDBINFILE:", 'B' },
+	{ "BINFILE:", 'b' },
+};
+
+static int writePart(const char *folder, char type, const char *name, const uint8_t *data, size_t size)
+{
+	char			path[PATH_MAX];
+	FILE *			part;
+
+	if (snprintf(path, sizeof(path), "parts/%s", name) >= (int) sizeof(path)) return 1;
+	if ((part = createFile(folder, path, "w")) == NULL) return 1;
+
+	if (type != 'b')
+		fwrite(data, 1, size, part);
+	else
+	{
+		const uint8_t *	end = data + size;
+		uint8_t			buffer[FILE_BUFFER_SIZE];
+		size_t			used = 0;
+
+		/* line by line with leading and trailing blanks removed, like 'read' does it */
+		while (data < end)
+		{
+			const uint8_t *	eol = memchr(data, '\n', end - data);
+			const uint8_t *	next = (eol ? eol + 1 : end);
+
+			if (eol == NULL) eol = end;
+			while (data < eol && (*data == ' ' || *data == '\t')) data++;
+			while (eol > data && (eol[-1] == ' ' || eol[-1] == '\t')) eol--;
+
+			/* the worst case for invalid data is twice the size of the line */
+			if (used + 2 * (eol - data) > sizeof(buffer))
+			{
+				fwrite(buffer, 1, used, part);
+				used = 0;
+			}
+			if ((size_t) (2 * (eol - data)) > sizeof(buffer))
+			{
+				uint8_t *	large = malloc(2 * (eol - data));
+
+				if (large == NULL)
+				{
+					fprintf(stderr, "Error %d allocating memory for line buffer.\n", errno);
+					fclose(part);
+					return 1;
+				}
+				fwrite(large, 1, decodeHexLine(data, eol - data, large), part);
+				free(large);
+			}
+			else
+				used += decodeHexLine(data, eol - data, buffer + used);
+			data = next;
+		}
+		fwrite(buffer, 1, used, part);
+	}
+
+	return closeFile(part, name);
+}
+
+static int decompose(const char *inputName)
+{
+	struct inputData	input;
+	char				folder[PATH_MAX];
+	const char *		tmp = getenv("TMPDIR");
+	FILE *				file;
+	FILE *				filelist = NULL;
+	FILE *				tail = NULL;
+	const uint8_t *		line;
+	const uint8_t *		end;
+	const uint8_t *		body = NULL;
+	unsigned int		lineNumber = 0;
+	unsigned int		partStart = 0;
+	char				partType = 0;
+	char				partName[PATH_MAX];
+	int					header = 1;
+	int					rc = 1;
+
+	if (loadInput(inputName, &input)) return 1;
+
+	if (tmp == NULL || *tmp == 0) tmp = "/tmp";
+	if (snprintf(folder, sizeof(folder), "%s/tmp.XXXXXX", tmp) >= (int) sizeof(folder) || mkdtemp(folder) == NULL)
+	{
+		fprintf(stderr, "Error %d creating temporary folder.\n", errno);
+		releaseInput(&input);
+		return 1;
+	}
+
+	if ((file = createFile(folder, "input", "w")) == NULL) goto exit;
+	fwrite(input.data, 1, input.size, file);
+	if (closeFile(file, "input")) goto exit;
+
+	if (snprintf(partName, sizeof(partName), "%s/parts", folder) >= (int) sizeof(partName) || mkdir(partName, 0777) == -1)
+	{
+		fprintf(stderr, "Error %d creating folder '%s'.\n", errno, partName);
+		goto exit;
+	}
+
+	if ((filelist = createFile(folder, "filelist", "w")) == NULL) goto exit;
+	if ((file = createFile(folder, "header", "w")) == NULL) goto exit;
+
+	/* one pass over all lines, only lines starting with '**** ' are of interest */
+	for (line = input.data, end = input.data + input.size; line < end; )
+	{
+		const uint8_t *	eol = memchr(line, '\n', end - line);
+		const uint8_t *	next = (eol ? eol + 1 : end);
+		const char *	content;
+		size_t			contentSize;
+		size_t			i;
+
+		lineNumber++;
+		if (eol == NULL) eol = end;
+
+		if (eol - line < 5 || memcmp(line, "**** ", 5) != 0)
+		{
+			line = next;
+			continue;
+		}
+
+		content = (const char *) line + 5;
+		contentSize = eol - line - 5;
+		while (contentSize > 0 && (content[contentSize - 1] == ' ' || content[contentSize - 1] == '\t')) contentSize--;
+
+		for (i = 0; i < sizeof(partTypes) / sizeof(partTypes[0]); i++)
+		{
+			size_t		markerSize = strlen(partTypes[i].marker);
+
+			if (contentSize >= markerSize && memcmp(content, partTypes[i].marker, markerSize) == 0)
+			{
+				if (header)
+				{
+					fwrite(input.data, 1, line - input.data, file);
+					header = 0;
+				}
+				if (contentSize - markerSize >= sizeof(partName)) contentSize = sizeof(partName) - 1 + markerSize;
+				memcpy(partName, content + markerSize, contentSize - markerSize);
+				partName[contentSize - markerSize] = 0;
+				partType = partTypes[i].type;
+				partStart = lineNumber;
+				body = next;
+				break;
+			}
+		}
+
+		if (i == sizeof(partTypes) / sizeof(partTypes[0]))
+		{
+			if (contentSize >= 11 && memcmp(content, "END OF FILE", 11) == 0 && partType)
+			{
+				/* an empty part is the marker line itself for 'sed -n "<first>,<last> p"' */
+				if (body == line)
+					rc = writePart(folder, partType, partName, line, next - line);
+				else
+					rc = writePart(folder, partType, partName, body, line - body);
+				if (rc) goto exit;
+				rc = 1;
+				fprintf(filelist, "%c %u %u %s\n", partType, partStart + 1, lineNumber - 1, partName);
+			}
+			else if (contentSize >= 13 && memcmp(content, "END OF EXPORT", 13) == 0)
+			{
+				const char *	value = content + 14;
+				size_t			valueSize = (contentSize > 13 && content[13] == ' ' ? contentSize - 14 : 0);
+
+				/* the value is everything in front of the last ' *' */
+				while (valueSize >= 2 && !(value[valueSize - 2] == ' ' && value[valueSize - 1] == '*')) valueSize--;
+				valueSize = (valueSize >= 2 ? valueSize - 2 : 0);
+
+				if (tail == NULL && (tail = createFile(folder, "tail", "a")) == NULL) goto exit;
+				fprintf(tail, "chksum=%.*s\n", (int) valueSize, value);
+			}
+		}
+
+		line = next;
+	}
+
+	rc = closeFile(file, "header");
+	file = NULL;
+	if (closeFile(filelist, "filelist")) rc = 1;
+	filelist = NULL;
+
+	/* the checksum data of the header and of all parts is cached in the folder for later use */
+	if (rc == 0)
+	{
+		uint32_t	checksum;
+
+		crc32Select();
+		rc = exportChecksumFolder(folder, &checksum);
+	}
+	if (rc == 0) printf("%s\n", folder);
+
+exit:
+	if (file) fclose(file);
+	if (filelist && closeFile(filelist, "filelist")) rc = 1;
+	if (tail && closeFile(tail, "tail")) rc = 1;
+	releaseInput(&input);
+	return rc;
+}
+
+static int copyFile(FILE *output, const char *folder, const char *name)
+{
+	char			path[PATH_MAX];
+	uint8_t			buffer[READ_BUFFER_SIZE];
+	size_t			readBytes;
+	FILE *			input;
+
+	if (snprintf(path, sizeof(path), "%s/%s", folder, name) >= (int) sizeof(path)) return 1;
+
+	if ((input = fopen(path, "r")) == NULL)
+	{
+		fprintf(stderr, "Error %d opening file '%s'.\n", errno, path);
+		return 1;
+	}
+
+	while ((readBytes = fread(buffer, 1, sizeof(buffer), input)) > 0) fwrite(buffer, 1, readBytes, output);
+	fclose(input);
+
+	return 0;
+}
+
+static int encodeFile(FILE *output, const char *folder, const char *name)
+{
+	char			path[PATH_MAX];
+	uint8_t			buffer[READ_BUFFER_SIZE - (READ_BUFFER_SIZE % HEX_BYTES_PER_LINE)];
+	char			line[2 * HEX_BYTES_PER_LINE + 1];
+	size_t			readBytes;
+	size_t			total = 0;
+	size_t			offset;
+	FILE *			input;
+
+	if (snprintf(path, sizeof(path), "%s/parts/%s", folder, name) >= (int) sizeof(path)) return 1;
+
+	if ((input = fopen(path, "r")) == NULL)
+	{
+		fprintf(stderr, "Error %d opening file '%s'.\n", errno, path);
+		return 1;
+	}
+
+	while ((readBytes = fread(buffer, 1, sizeof(buffer), input)) > 0)
+	{
+		for (offset = 0; offset < readBytes; offset += HEX_BYTES_PER_LINE)
+		{
+			size_t		count = (readBytes - offset < HEX_BYTES_PER_LINE ? readBytes - offset : HEX_BYTES_PER_LINE);
+
+			fwrite(line, 1, encodeHexLine(buffer + offset, count, line), output);
+		}
+		total += readBytes;
+	}
+	fclose(input);
+
+	/* an empty file is an empty line */
+	if (total == 0) fputc('\n', output);
+
+	return 0;
+}
+
+static int compose(const char *folder)
+{
+	char				path[PATH_MAX];
+	FILE *				output;
+	FILE *				input;
+	char *				line = NULL;
+	size_t				lineSize = 0;
+	char *				checksum = NULL;
+	size_t				checksumSize = 0;
+	ssize_t				length;
+	int					rc = 0;
+
+	if ((output = createFile(folder, "output", "w+")) == NULL) return 1;
+
+	copyFile(output, folder, "header");
+
+	snprintf(path, sizeof(path), "%s/filelist", folder);
+	if ((input = fopen(path, "r")) != NULL)
+	{
+		while ((length = getline(&line, &lineSize, input)) != -1)
+		{
+			char		type[64] = "";
+			char		name[PATH_MAX] = "";
+
+			if (length >= (ssize_t) sizeof(name)) continue;
+			sscanf(line, "%63s %*s %*s %s", type, name);
+
+			if (strcmp(type, "c") == 0)
+			{
+				fprintf(output, "**** CFGFILE:%s\n", name);
+				snprintf(path, sizeof(path), "parts/%s", name);
+				copyFile(output, folder, path);
+			}
+			else if (strcmp(type, "b") == 0)
+			{
+				fprintf(output, "**** BINFILE:%s\n", name);
+				encodeFile(output, folder, name);
+			}
+			else
+			{
+				fprintf(output, "**** CRYPTEDBINFILE:%s\n", name);
+				snprintf(path, sizeof(path), "parts/%s", name);
+				copyFile(output, folder, path);
+			}
+			fputs("**** END OF FILE ****\n", output);
+		}
+		fclose(input);
+	}
+	else
+		fprintf(stderr, "Error %d opening file '%s'.\n", errno, path);
+
+	/* the value after the last '=' of each line, multiple lines are joined with newlines */
+	snprintf(path, sizeof(path), "%s/tail", folder);
+	if ((input = fopen(path, "r")) != NULL)
+	{
+		while ((length = getline(&line, &lineSize, input)) != -1)
+		{
+			char *		value = strrchr(line, '=');
+			char *		joined;
+
+			if (value == NULL) continue;
+			value++;
+			if ((joined = realloc(checksum, checksumSize + strlen(value) + 1)) == NULL)
+			{
+				fprintf(stderr, "Error %d allocating memory for checksum value.\n", errno);
+				rc = 1;
+				break;
+			}
+			checksum = joined;
+			strcpy(checksum + checksumSize, value);
+			checksumSize += strlen(value);
+		}
+		fclose(input);
+	}
+	else
+		fprintf(stderr, "Error %d opening file '%s'.\n", errno, path);
+	while (checksumSize > 0 && checksum[checksumSize - 1] == '\n') checksum[--checksumSize] = 0;
+
+	fprintf(output, "**** END OF EXPORT %s ****\n", (checksum ? checksum : ""));
+	free(checksum);
+	free(line);
+
+	if (fflush(output) || ferror(output))
+	{
+		fprintf(stderr, "Error %d writing file '%s/output'.\n", errno, folder);
+		fclose(output);
+		return 1;
+	}
+
+	rewind(output);
+	{
+		uint8_t		buffer[READ_BUFFER_SIZE];
+		size_t		readBytes;
+
+		while ((readBytes = fread(buffer, 1, sizeof(buffer), output)) > 0)
+		{
+			if (fwrite(buffer, 1, readBytes, stdout) != readBytes)
+			{
+				fprintf(stderr, "Error %d writing to STDOUT.\n", errno);
+				rc = 1;
+				break;
+			}
+		}
+	}
+	fclose(output);
+
+	return rc;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s decompose [ <export> ]\n", name);
+	fprintf(stderr, "       %s compose <folder>\n\n", name);
+	fprintf(stderr, "'decompose' splits a FRITZ!OS settings export (from the specified file or from STDIN) into its\n");
+	fprintf(stderr, "parts, the name of the created folder is written to STDOUT.\n");
+	fprintf(stderr, "'compose' builds an export from the parts in the specified folder and writes it to STDOUT.\n");
+}
+
+int main(int argc, char **argv)
+{
+	if (argc >= 2 && argc <= 3 && strcmp(argv[1], "decompose") == 0) return decompose(argc == 3 ? argv[2] : NULL);
+	if (argc == 3 && strcmp(argv[1], "compose") == 0) return compose(argv[2]);
+
+	usage(argv[0]);
+	return 1;
+}
@@ -1,4 +1,6 @@
 #! /bin/sh
 # SPDX-License-Identifier: GPL-2.0-or-later
 [ -t 1 ] && exec 1>./900-patchkernel_source
-diff -u /dev/null ./yf_patchkernel.c | sed -e '1s|.*|--- /dev/null|' -e '2s|.*|+++ linux-3.10/drivers/net/yf_patchkernel.c|'
+for f in yf_patchengine.h yf_patchkernel.c; do
+	diff -u /dev/null ./$f | sed -e '1s|.*|--- /dev/null|' -e "2s|.*|+++ linux-3.10/drivers/net/$f|"
+done
@@ -0,0 +1,539 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/************************************************************************************************
+ *                                                                                              *
+ * @file        yf_patchengine.h                                                                *
+ * @brief       portable matching and patching engine of yf_patchkernel                         *
+ * @version     0.4                                                                             *
+ * @author      PeH                                                                             *
+ *                                                                                              *
+ ************************************************************************************************
+ *                                                                                              *
+ * Copyright (C) 2019 Peter Haemmerlein (peterpawn@yourfritz.de)                                *
+ *                                                                                              *
+ ************************************************************************************************
+ *                                                                                              *
+ * This project is free software, you can redistribute it and/or modify it under the terms of   *
+ * the GNU General Public License (version 2) as published by the Free Software Foundation.     *
+ *                                                                                              *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;    *
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.    *
+ * See the GNU General Public License under https://www.gnu.org/licenses/gpl-2.0.html for more  *
+ * details.                                                                                     *
+ *                                                                                              *
+ ************************************************************************************************
+ *                                                                                              *
+ * The patch tables and the code to find and apply the patches, without any dependency on the   *
+ * kernel - it's used by the kernel module and by userspace tools, which work with a copy of    *
+ * the kernel's instructions (in host byte order).                                              *
+ *                                                                                              *
+ * The including file has to define:                                                            *
+ *                                                                                              *
+ * YF_INFO(args...)             - output a message                                              *
+ * YF_ADDRESS(ptr)              - the (32 bit) address of an instruction on the target system   *
+ * YF_FLUSH_ICACHE(first, last) - flush the instruction cache for the changed words             *
+ * YF_SKB_SK_OFFSET             - the offset of member 'sk' in 'struct sk_buff'                 *
+ *                                                                                              *
+ ************************************************************************************************
+*/
+
+#ifndef YF_PATCHENGINE_H
+#define YF_PATCHENGINE_H
+
+#define MIPS_NOP       0x00000000 // it's a shift instruction, which does nothing: sll zero, zero, 0
+#define MIPS_ADDIU     0x24000000 // add immediate value to RS and store the result in RT
+#define MIPS_LW        0x8C000000 // load word from offset to BASE and store it in RT
+#define MIPS_TNE       0x00000036 // trap if RS not equal RT
+#define MIPS_BASE_MASK 0x03E00000 // base register bits (bits 21 to 26)
+#define MIPS_RS_MASK   0x03E00000 // RS register bits (bits 21 to 26) - same as BASE
+#define MIPS_RT_MASK   0x001F0000 // RT register bits (bits 16 to 20)
+#define MIPS_OFFS_MASK 0x0000FFFF // offset bits in the used instructions (16 bits value)
+#define MIPS_BASE_SHFT 21         // base register bits shifted left
+#define MIPS_RS_SHFT   21         // RS register bits shifted left
+#define MIPS_RT_SHFT   16         // RT register bits shifted left
+#define MIPS_REG_V0    2          // register v0
+#define MIPS_REG_V1    3          // register v1
+#define MIPS_REG_A0    4          // register a0
+#define MIPS_TRAP_CODE 0x00000300 // trap code 12 (encoded in bits 6 to 15)
+#define MIPS_AND_MASK  0xFFFFFFFF // all bits set for logical AND mask
+
+typedef struct patchEntry
+{
+	char            *fname;         // kernel symbol name, where to start with a search
+	unsigned int    *startAddress;  // the result from kallsyms_lookup_name for the above symbol
+	unsigned int    startOffset;    // number of instructions (32 bits per instruction) to skip prior to first comparision
+	unsigned int    maxOffset;      // maximum number of instructions to process, while searching for this patch
+	unsigned int    lookFor;        // the value to look for, the source value will be modified by AND and OR masks first (see below)
+	unsigned int    andMask;        // the mask to use for a logical AND operation, may be used to mask out unwanted bits from value
+	unsigned int    orMask;         // the mask to use for a logical OR operation, may be used as a mask to set some additional bits or to ensure, they're set already
+	unsigned int    verifyOffset;   // the offset of another value to check, if the search from above was successful, if it's 0, no further check is performed
+	unsigned int    verifyValue;    // the expected value from verification, after processing AND and OR operations with masks below
+	unsigned int    verifyAndMask;  // the AND mask for verification
+	unsigned int    verifyOrMask;   // the OR mask for verification
+	unsigned int    patchOffset;    // the offset of instruction to patch, relative to the search result (not to verification offset)
+	unsigned int    patchValue;     // the new value to store at patched location
+	unsigned int    *patchAddress;  // the address, where the change was applied
+	unsigned int    originalValue;  // the original value prior to patching
+	int             isPatched;      // not zero, if this patch was applied successfully
+	int             isDone;         // not zero, if the search for this patch has finished (while scanning a function)
+	unsigned int    lookups;        // statistics: number of successful symbol lookups
+	unsigned int    scanned;        // statistics: number of instructions compared, while searching for this patch
+	int             hitOffset;      // statistics: offset of the last search result from the start of the function, -1 if none was found
+	unsigned int    patchCount;     // statistics: number of times this patch was applied
+	unsigned int    revertCount;    // statistics: number of times this patch was reverted
+} patchEntry_t;
+
+// entries to patch for TUN device on 7490/75x0 devices, starting with FRITZ!OS version 07.0x
+
+static patchEntry_t patchesForTunDevice[] = {
+	{
+		.fname = "ip_forward",
+		.maxOffset = 10,
+		.lookFor = MIPS_LW + (MIPS_REG_A0 << MIPS_BASE_SHFT) + YF_SKB_SK_OFFSET,
+		.andMask = MIPS_AND_MASK - MIPS_RT_MASK,
+		.patchValue = MIPS_ADDIU + (MIPS_REG_V0 << MIPS_RT_SHFT)
+	},
+	{
+		.fname = "netif_receive_skb",
+		.maxOffset = 10,
+		.lookFor = MIPS_LW + (MIPS_REG_A0 << MIPS_BASE_SHFT) + YF_SKB_SK_OFFSET,
+		.andMask = MIPS_AND_MASK - MIPS_RT_MASK,
+		.verifyOffset = 1,
+		.verifyValue = MIPS_TNE + MIPS_TRAP_CODE,
+		.verifyAndMask = MIPS_AND_MASK - MIPS_RT_MASK,
+		.patchOffset = 1,
+		.patchValue = MIPS_NOP
+	},
+	{
+		.fname = "__netif_receive_skb",
+		.maxOffset = 8,
+		.lookFor = MIPS_LW + (MIPS_REG_A0 << MIPS_BASE_SHFT) + YF_SKB_SK_OFFSET,
+		.andMask = MIPS_AND_MASK - MIPS_RT_MASK,
+		.verifyOffset = 1,
+		.verifyValue = MIPS_TNE + MIPS_TRAP_CODE,
+		.verifyAndMask = MIPS_AND_MASK - MIPS_RT_MASK,
+		.patchOffset = 1,
+		.patchValue = MIPS_NOP
+	},
+	{
+		.fname = NULL		// last entry needed as 'end of list' marker
+	}
+};
+
+// forget the results of a previous run
+
+static inline void yf_patchkernel_reset(patchEntry_t *patch)
+{
+	while (patch->fname)
+	{
+		patch->startAddress = NULL;
+		patch->patchAddress = NULL;
+		patch->hitOffset = -1;
+		patch++;
+	}
+}
+
+// called for each symbol, stores the address of each symbol needed and returns 1, if all symbols are known
+
+static inline int yf_patchkernel_resolve(patchEntry_t *patches, const char *name, unsigned long address)
+{
+	patchEntry_t	*patch;
+	int		unresolved = 0;
+
+	for (patch = patches; patch->fname; patch++)
+	{
+		if (patch->startAddress) continue;	// the first symbol found wins, like with kallsyms_lookup_name()
+
+		if (strcmp(patch->fname, name) == 0)
+		{
+			patch->startAddress = (unsigned int *)address;
+			patch->lookups++;
+		}
+		else
+			unresolved++;
+	}
+
+	return (unresolved == 0);
+}
+
+// patches are grouped by function, the first entry for a function represents the whole group
+
+static inline int yf_patchkernel_is_first(patchEntry_t *patches, patchEntry_t *patch)
+{
+	patchEntry_t	*other;
+
+	if (!(patch->startAddress)) return 0;
+
+	for (other = patches; other < patch; other++)
+	{
+		if (other->startAddress == patch->startAddress) return 0;
+	}
+
+	return 1;
+}
+
+// check, if another entry for this function has taken the word at the specified address already
+
+static inline int yf_patchkernel_is_taken(patchEntry_t *patches, patchEntry_t *patch, unsigned int *address)
+{
+	patchEntry_t	*other;
+
+	for (other = patches; other->fname; other++)
+	{
+		if (other != patch && other->startAddress == patch->startAddress && other->patchAddress == address) return 1;
+	}
+
+	return 0;
+}
+
+// scan the instructions of a single function for all patches of this function at once, each word is patched once only
+
+static inline void yf_patchkernel_scan(patchEntry_t *patches, unsigned int *function)
+{
+	patchEntry_t	*patch;
+	unsigned int	*first = NULL;
+	unsigned int	*last = NULL;
+	unsigned int	*ptr;
+	unsigned int	value;
+	unsigned int	verify;
+	unsigned int	pending = 0;
+
+	for (patch = patches; patch->fname; patch++)
+	{
+		if (patch->startAddress != function) continue;
+
+		if (patch->maxOffset == 0) continue;
+		if (!first || function + patch->startOffset < first) first = function + patch->startOffset;
+		if (!last || function + patch->startOffset + patch->maxOffset > last) last = function + patch->startOffset + patch->maxOffset;
+		patch->isDone = 0;
+		pending++;
+	}
+
+	for (ptr = first; pending && ptr < last; ptr++)
+	{
+		for (patch = patches; patch->fname; patch++)
+		{
+			if (patch->startAddress != function || patch->isDone) continue;
+			if (ptr < function + patch->startOffset || ptr >= function + patch->startOffset + patch->maxOffset) continue;
+
+			if (yf_patchkernel_is_taken(patches, patch, ptr + patch->patchOffset)) continue;
+
+			patch->scanned++;
+
+			if (*(ptr + patch->patchOffset) == patch->patchValue)
+			{
+				YF_INFO("Found patched instruction (%#010x) at address %#010x, looks like this patch was applied already or is not necessary.\n", *(ptr + patch->patchOffset), YF_ADDRESS(ptr + patch->patchOffset));
+				patch->isDone = 1;
+				pending--;
+				continue;
+			}
+
+			value = (*ptr & patch->andMask) | patch->orMask;
+			if (value != patch->lookFor) continue;
+
+			if (patch->verifyOffset != 0)
+			{
+				verify = (*(ptr + patch->verifyOffset) & patch->verifyAndMask) | patch->verifyOrMask;
+				if (verify != patch->verifyValue) continue;
+			}
+
+			patch->patchAddress = ptr + patch->patchOffset;
+			patch->hitOffset = ptr - function;
+			patch->isDone = 1;
+			pending--;
+		}
+	}
+}
+
+// scan all functions with resolved symbols
+
+static inline void yf_patchkernel_scan_all(patchEntry_t *patches)
+{
+	patchEntry_t	*patch;
+
+	for (patch = patches; patch->fname; patch++)
+	{
+		if (yf_patchkernel_is_first(patches, patch)) yf_patchkernel_scan(patches, patch->startAddress);
+	}
+}
+
+// write all patches found for a single function (or for all functions, if it's NULL), without flushing the instruction cache
+
+static inline unsigned int yf_patchkernel_write(patchEntry_t *patches, unsigned int *function)
+{
+	patchEntry_t	*patch;
+	unsigned int	applied = 0;
+
+	for (patch = patches; patch->fname; patch++)
+	{
+		if ((function && patch->startAddress != function) || !patch->patchAddress || patch->isPatched) continue;
+
+		patch->originalValue = *(patch->patchAddress);
+		*(patch->patchAddress) = patch->patchValue;
+		patch->isPatched = 1;
+		patch->patchCount++;
+		applied++;
+	}
+
+	return applied;
+}
+
+// flush the instruction cache once for each function with changed (patched or restored) words
+
+static inline void yf_patchkernel_flush(patchEntry_t *patches)
+{
+	patchEntry_t	*patch;
+	patchEntry_t	*other;
+	unsigned int	*first;
+	unsigned int	*last;
+
+	for (patch = patches; patch->fname; patch++)
+	{
+		if (!yf_patchkernel_is_first(patches, patch)) continue;
+
+		first = NULL;
+		last = NULL;
+
+		for (other = patch; other->fname; other++)
+		{
+			if (other->startAddress != patch->startAddress || !other->patchAddress) continue;
+
+			if (!first || other->patchAddress < first) first = other->patchAddress;
+			if (!last || other->patchAddress + 1 > last) last = other->patchAddress + 1;
+		}
+
+		if (first) YF_FLUSH_ICACHE(first, last);
+	}
+}
+
+// apply all patches found for a single function and flush the instruction cache once
+
+static inline unsigned int yf_patchkernel_apply(patchEntry_t *patches, unsigned int *function)
+{
+	patchEntry_t	*patch;
+	unsigned int	*first = NULL;
+	unsigned int	*last = NULL;
+	unsigned int	applied;
+
+	applied = yf_patchkernel_write(patches, function);
+
+	for (patch = patches; applied && patch->fname; patch++)
+	{
+		if (patch->startAddress != function || !patch->isPatched) continue;
+
+		if (!first || patch->patchAddress < first) first = patch->patchAddress;
+		if (!last || patch->patchAddress + 1 > last) last = patch->patchAddress + 1;
+
+		YF_INFO("Found instruction to patch (%#010x) at address %#010x, replaced it with %#010x.\n", patch->originalValue, YF_ADDRESS(patch->patchAddress), *(patch->patchAddress));
+	}
+
+	if (applied) YF_FLUSH_ICACHE(first, last);
+
+	return applied;
+}
+
+// scan and patch all functions with resolved symbols
+
+static inline unsigned int yf_patchkernel_process(patchEntry_t *patches)
+{
+	unsigned int	patches_applied = 0;
+	patchEntry_t	*patch;
+	patchEntry_t	*other;
+
+	for (patch = patches; patch->fname; patch++)
+	{
+		if (!(patch->startAddress))
+		{
+			YF_INFO("Unable to locate kernel symbol '%s', patch skipped.\n", patch->fname);
+			continue;
+		}
+
+		if (!yf_patchkernel_is_first(patches, patch)) continue;
+
+		YF_INFO("Patching kernel function '%s' at address %#010x.\n", patch->fname, YF_ADDRESS(patch->startAddress));
+
+		yf_patchkernel_scan(patches, patch->startAddress);
+		patches_applied += yf_patchkernel_apply(patches, patch->startAddress);
+
+		for (other = patch; other->fname; other++)
+		{
+			if (other->startAddress == patch->startAddress && !(other->isPatched))
+			{
+				YF_INFO("No instruction to patch found in function '%s', patch skipped.\n", other->fname);
+			}
+		}
+	}
+
+	return patches_applied;
+}
+
+// restore the original value of a single entry
+
+static inline void yf_patchkernel_revert_entry(patchEntry_t *patch)
+{
+	*(patch->patchAddress) = patch->originalValue;
+	patch->isPatched = 0;
+	patch->revertCount++;
+}
+
+// restore the original values in reverse order without any message, e.g. from a stop_machine() callback
+
+static inline unsigned int yf_patchkernel_revert(patchEntry_t *patches)
+{
+	patchEntry_t	*patch = patches;
+	unsigned int	restored = 0;
+
+	while (patch->fname) patch++;
+
+	while (patch > patches)
+	{
+		patch--;
+		if (patch->isPatched)
+		{
+			yf_patchkernel_revert_entry(patch);
+			restored++;
+		}
+	}
+
+	return restored;
+}
+
+// restore the original values in reverse order (a word may have been patched twice before), the instruction cache has to be
+// flushed by the caller (see yf_patchkernel_flush)
+
+static inline unsigned int yf_patchkernel_restore(patchEntry_t *patches)
+{
+	patchEntry_t	*patch = patches;
+	unsigned int	restored = 0;
+
+	while (patch->fname) patch++;
+
+	while (patch > patches)
+	{
+		patch--;
+		if (patch->isPatched)
+		{
+			yf_patchkernel_revert_entry(patch);
+			restored++;
+
+			YF_INFO("Reversed patch in '%s' at address %#010x to original value %#010x.\n", patch->fname, YF_ADDRESS(patch->patchAddress), patch->originalValue);
+		}
+	}
+
+	return restored;
+}
+
+// the number of lines in a patch table in text form (the maximum number of entries)
+
+static inline unsigned int yf_patchkernel_lines(const char *text)
+{
+	unsigned int	lines = 1;
+
+	for (; *text; text++)
+	{
+		if (*text == '\n') lines++;
+	}
+
+	return lines;
+}
+
+static inline int yf_patchkernel_is_space(char c)
+{
+	return (c == ' ' || c == '\t' || c == '\r');
+}
+
+static inline int yf_patchkernel_number(char **text, unsigned int *value)
+{
+	char		*ptr = *text;
+	unsigned int	base = 10;
+	unsigned int	digit;
+	unsigned int	digits = 0;
+
+	*value = 0;
+
+	if (ptr[0] == '0' && (ptr[1] == 'x' || ptr[1] == 'X'))
+	{
+		base = 16;
+		ptr += 2;
+	}
+
+	for (;; ptr++, digits++)
+	{
+		if (*ptr >= '0' && *ptr <= '9')
+			digit = *ptr - '0';
+		else if (base == 16 && (*ptr | 0x20) >= 'a' && (*ptr | 0x20) <= 'f')
+			digit = (*ptr | 0x20) - 'a' + 10;
+		else
+			break;
+
+		*value = *value * base + digit;
+	}
+
+	*text = ptr;
+
+	return (digits > 0 && (*ptr == 0 || yf_patchkernel_is_space(*ptr)));
+}
+
+/*
+ * parse a patch table in text form, each line contains an entry with all values in the order of the structure members:
+ *
+ * <fname> <startOffset> <maxOffset> <lookFor> <andMask> <orMask> <verifyOffset> <verifyValue> <verifyAndMask> <verifyOrMask> <patchOffset> <patchValue>
+ *
+ * Numbers may be specified as decimal or hexadecimal (with '0x' prefix) values, empty lines and lines starting with '#' are
+ * ignored. The text is modified, names are terminated in place. The 'patches' array needs room for yf_patchkernel_lines()
+ * entries and the end of list marker.
+ *
+ * Returns the number of entries read or the negative line number of an invalid line.
+ */
+
+static inline int yf_patchkernel_parse(char *text, patchEntry_t *patches)
+{
+	patchEntry_t	*patch = patches;
+	char		*next;
+	unsigned int	values[11];
+	unsigned int	line;
+	unsigned int	i;
+
+	for (line = 1; text; text = next, line++)
+	{
+		if ((next = strchr(text, '\n')) != NULL) *(next++) = 0;
+
+		while (yf_patchkernel_is_space(*text)) text++;
+		if (*text == 0 || *text == '#') continue;
+
+		memset(patch, 0, sizeof(patchEntry_t));
+		patch->fname = text;
+		while (*text && !yf_patchkernel_is_space(*text)) text++;
+		if (*text == 0) return -line;
+		*(text++) = 0;
+
+		for (i = 0; i < 11; i++)
+		{
+			while (yf_patchkernel_is_space(*text)) text++;
+			if (!yf_patchkernel_number(&text, &values[i])) return -line;
+		}
+
+		while (yf_patchkernel_is_space(*text)) text++;
+		if (*text != 0) return -line;
+
+		patch->startOffset = values[0];
+		patch->maxOffset = values[1];
+		patch->lookFor = values[2];
+		patch->andMask = values[3];
+		patch->orMask = values[4];
+		patch->verifyOffset = values[5];
+		patch->verifyValue = values[6];
+		patch->verifyAndMask = values[7];
+		patch->verifyOrMask = values[8];
+		patch->patchOffset = values[9];
+		patch->patchValue = values[10];
+		patch->hitOffset = -1;
+		patch++;
+	}
+
+	patch->fname = NULL;
+
+	return patch - patches;
+}
+
+#endif
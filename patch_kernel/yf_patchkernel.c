@@ -6,7 +6,7 @@
  * @see         https://www.ip-phone-forum.de/threads/fritz-os7-openvpn-auf-7590-kein-tun-      *
  *              modul.300433/page-3#post-2309487                                                *
  * @brief       patch kernel instructions while loading this module                             *
- * @version     0.2                                                                             *
+ * @version     0.4                                                                             *
  * @author      PeH                                                                             *
  * @date        17.01.2019                                                                      *
  *                                                                                              *
@@ -28,7 +28,8 @@
  *                                                                                              *
  * This loadable kernel module looks for machine instructions at specified locations in the     *
  * running kernel and replaces them (in case of a hit) with another instruction (only in-place  *
- * patches are supported).                                                                      *
+ * patches are supported). The tables and the matching code are located in yf_patchengine.h.    *
+ * Additional patch tables may be loaded at runtime via debugfs.                                *
  *                                                                                              *
  ************************************************************************************************
 */
@@ -46,174 +47,281 @@
 #include <linux/init.h>
 #include <linux/skbuff.h>
 #include <linux/kallsyms.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/stop_machine.h>
+#include <asm/cacheflush.h>
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Peter Haemmerlein");
 MODULE_DESCRIPTION("Patches some forgotten AVM traps on MIPS kernels.");
-MODULE_VERSION("0.2");
-
-#define MIPS_NOP       0x00000000 // it's a shift instruction, which does nothing: sll zero, zero, 0
-#define MIPS_ADDIU     0x24000000 // add immediate value to RS and store the result in RT
-#define MIPS_LW        0x8C000000 // load word from offset to BASE and store it in RT
-#define MIPS_TNE       0x00000036 // trap if RS not equal RT
-#define MIPS_BASE_MASK 0x03E00000 // base register bits (bits 21 to 26)
-#define MIPS_RS_MASK   0x03E00000 // RS register bits (bits 21 to 26) - same as BASE
-#define MIPS_RT_MASK   0x001F0000 // RT register bits (bits 16 to 20)
-#define MIPS_OFFS_MASK 0x0000FFFF // offset bits in the used instructions (16 bits value)
-#define MIPS_BASE_SHFT 21         // base register bits shifted left
-#define MIPS_RS_SHFT   21         // RS register bits shifted left
-#define MIPS_RT_SHFT   16         // RT register bits shifted left
-#define MIPS_REG_V0    2          // register v0
-#define MIPS_REG_V1    3          // register v1
-#define MIPS_REG_A0    4          // register a0
-#define MIPS_TRAP_CODE 0x00000300 // trap code 12 (encoded in bits 6 to 15)
-#define MIPS_AND_MASK  0xFFFFFFFF // all bits set for logical AND mask
+MODULE_VERSION("0.4");
 
 #define YF_INFO(args...) pr_info("[%s] ",__this_module.name);pr_cont(args)
+#define YF_ADDRESS(ptr) ((unsigned int)(ptr))
+#define YF_FLUSH_ICACHE(first, last) flush_icache_range((unsigned long)(first), (unsigned long)(last))
+#define YF_SKB_SK_OFFSET offsetof(struct sk_buff, sk)
 
-typedef struct patchEntry
-{
-	unsigned char   *fname;         // kernel symbol name, where to start with a search
-	unsigned int    *startAddress;  // the result from kallsyms_lookup_name for the above symbol
-	unsigned int    startOffset;    // number of instructions (32 bits per instruction) to skip prior to first comparision
-	unsigned int    maxOffset;      // maximum number of instructions to process, while searching for this patch
-	unsigned int    lookFor;        // the value to look for, the source value will be modified by AND and OR masks first (see below)
-	unsigned int    andMask;        // the mask to use for a logical AND operation, may be used to mask out unwanted bits from value
-	unsigned int    orMask;         // the mask to use for a logical OR operation, may be used as a mask to set some additional bits or to ensure, they're set already
-	unsigned int    verifyOffset;   // the offset of another value to check, if the search from above was successful, if it's 0, no further check is performed
-	unsigned int    verifyValue;    // the expected value from verification, after processing AND and OR operations with masks below
-	unsigned int    verifyAndMask;  // the AND mask for verification
-	unsigned int    verifyOrMask;   // the OR mask for verification
-	unsigned int    patchOffset;    // the offset of instruction to patch, relative to the search result (not to verification offset)
-	unsigned int    patchValue;     // the new value to store at patched location
-	unsigned int    *patchAddress;  // the address, where the change was applied
-	unsigned int    originalValue;  // the original value prior to patching
-	int             isPatched;      // not zero, if this patch was applied successfully
-} patchEntry_t;
+#include "yf_patchengine.h"
 
+static int yf_patchkernel_symbol(void *, const char *, struct module *, unsigned long);
 static unsigned int yf_patchkernel_patch(patchEntry_t *);
-static void yf_patchkernel_restore(patchEntry_t *);
 
-// entries to patch for TUN device on 7490/75x0 devices, starting with FRITZ!OS version 07.0x
+static unsigned int	patches_applied = 0;	// number of patches applied successfully
+
+// kallsyms_on_each_symbol() callback, the walk stops, if all symbols are known
+
+static int yf_patchkernel_symbol(void *data, const char *name, struct module *mod, unsigned long address)
+{
+	return yf_patchkernel_resolve((patchEntry_t *)data, name, address);
+}
+
+static unsigned int yf_patchkernel_patch(patchEntry_t *patches)
+{
+	yf_patchkernel_reset(patches);
+
+	// a single walk through the symbol table for all patches, instead of one lookup per patch
+
+	kallsyms_on_each_symbol(yf_patchkernel_symbol, patches);
+
+	return yf_patchkernel_process(patches);
+}
+
+/*
+ * patch tables loaded at runtime, the files are located in directory 'yf_patchkernel' of debugfs:
+ *
+ * table  - (write only) a patch table in text form (see yf_patchkernel_parse), it's applied only, if each entry finds
+ *          the instruction to patch - otherwise nothing gets changed
+ * revert - (write only) any data written reverts the patches from the loaded table
+ * status - (read only) statistics for each entry of the built-in and the loaded table
+ *
+ * A new table may only be loaded, if the patches from the previous one were reverted.
+ */
 
-static patchEntry_t patchesForTunDevice[] = {
+#define YF_TABLE_MAX_SIZE	(16 * 1024)	// maximum size of a patch table in text form
+
+static struct dentry	*debugfs_dir = NULL;	// the module's directory in debugfs
+static patchEntry_t	*runtime_patches = NULL;	// the table loaded via debugfs
+static char		*runtime_text = NULL;		// text of the loaded table, the names of its entries point into it
+static DEFINE_MUTEX(runtime_lock);		// protects the loaded table
+
+// stop_machine() callbacks, all words of a table are changed, while no other CPU executes any code - messages are
+// written by the caller afterwards
+
+static int yf_patchkernel_write_table(void *data)
+{
+	yf_patchkernel_write((patchEntry_t *)data, NULL);
+	return 0;
+}
+
+static int yf_patchkernel_restore_table(void *data)
+{
+	yf_patchkernel_revert((patchEntry_t *)data);
+	return 0;
+}
+
+// a loaded table is applied completely or not at all, so each entry with an address was reverted
+
+static void yf_patchkernel_log_reverted(patchEntry_t *patch)
+{
+	for (; patch->fname; patch++)
 	{
-		.fname = "ip_forward",
-		.maxOffset = 10,
-		.lookFor = MIPS_LW + (MIPS_REG_A0 << MIPS_BASE_SHFT) + offsetof(struct sk_buff, sk),
-		.andMask = MIPS_AND_MASK - MIPS_RT_MASK,
-		.patchValue = MIPS_ADDIU + (MIPS_REG_V0 << MIPS_RT_SHFT)
-	},
+		if (patch->patchAddress && !patch->isPatched)
+		{
+			YF_INFO("Reversed patch in '%s' at address %#010x to original value %#010x.\n", patch->fname, YF_ADDRESS(patch->patchAddress), patch->originalValue);
+		}
+	}
+}
+
+// each word may be patched by one entry only, from the loaded and the built-in table
+
+static int yf_patchkernel_is_overlapping(patchEntry_t *patches, patchEntry_t *patch)
+{
+	patchEntry_t	*other;
+
+	for (other = patches; other->fname; other++)
 	{
-		.fname = "netif_receive_skb",
-		.maxOffset = 10,
-		.lookFor = MIPS_LW + (MIPS_REG_A0 << MIPS_BASE_SHFT) + offsetof(struct sk_buff, sk),
-		.andMask = MIPS_AND_MASK - MIPS_RT_MASK,
-		.verifyOffset = 1,
-		.verifyValue = MIPS_TNE + MIPS_TRAP_CODE,
-		.verifyAndMask = MIPS_AND_MASK - MIPS_RT_MASK,
-		.patchOffset = 1,
-		.patchValue = MIPS_NOP
-	},
+		if (other != patch && other->patchAddress == patch->patchAddress) return 1;
+	}
+
+	for (other = patchesForTunDevice; other->fname; other++)
 	{
-		.fname = "__netif_receive_skb",
-		.maxOffset = 8,
-		.lookFor = MIPS_LW + (MIPS_REG_A0 << MIPS_BASE_SHFT) + offsetof(struct sk_buff, sk),
-		.andMask = MIPS_AND_MASK - MIPS_RT_MASK,
-		.verifyOffset = 1,
-		.verifyValue = MIPS_TNE + MIPS_TRAP_CODE,
-		.verifyAndMask = MIPS_AND_MASK - MIPS_RT_MASK,
-		.patchOffset = 1,
-		.patchValue = MIPS_NOP
-	},
+		if (other->patchAddress == patch->patchAddress) return 1;
+	}
+
+	return 0;
+}
+
+static int yf_patchkernel_is_applied(patchEntry_t *patch)
+{
+	while (patch && patch->fname)
 	{
-		.fname = NULL		// last entry needed as 'end of list' marker
+		if (patch->isPatched) return 1;
+		patch++;
 	}
-};
 
-static unsigned int	patches_applied = 0;	// number of patches applied successfully
+	return 0;
+}
 
-static unsigned int yf_patchkernel_patch(patchEntry_t *patches)
+static ssize_t yf_patchkernel_table_write(struct file *file, const char __user *buffer, size_t count, loff_t *ppos)
 {
-	unsigned int	patches_applied = 0;
-	patchEntry_t	*patch = patches;
+	char		*text;
+	patchEntry_t	*patches;
+	patchEntry_t	*patch;
+	int		entries;
+	ssize_t		rc = count;
+
+	if (count == 0 || count > YF_TABLE_MAX_SIZE) return -EINVAL;
+
+	if (!(text = kmalloc(count + 1, GFP_KERNEL))) return -ENOMEM;
+	if (copy_from_user(text, buffer, count))
+	{
+		kfree(text);
+		return -EFAULT;
+	}
+	text[count] = 0;
+
+	if (!(patches = kcalloc(yf_patchkernel_lines(text) + 1, sizeof(patchEntry_t), GFP_KERNEL)))
+	{
+		kfree(text);
+		return -ENOMEM;
+	}
+
+	if ((entries = yf_patchkernel_parse(text, patches)) <= 0)
+	{
+		if (entries < 0)
+		{
+			YF_INFO("Invalid entry in line %d of patch table, table rejected.\n", -entries);
+		}
+		rc = -EINVAL;
+		goto free;
+	}
 
-	unsigned int	*ptr;
-	unsigned int	offset;
-	unsigned int	value;
-	unsigned int	orgValue;
-	unsigned int	verify;
+	mutex_lock(&runtime_lock);
 
-	while (patch->fname)
+	if (yf_patchkernel_is_applied(runtime_patches))
 	{
-		ptr = (unsigned int *)kallsyms_lookup_name(patch->fname);
+		YF_INFO("The patches from the previous table have to be reverted first.\n");
+		rc = -EBUSY;
+		goto unlock;
+	}
+
+	yf_patchkernel_reset(patches);
+	kallsyms_on_each_symbol(yf_patchkernel_symbol, patches);
+	yf_patchkernel_scan_all(patches);
 
-		if (!ptr)
+	for (patch = patches; patch->fname; patch++)
+	{
+		if (!patch->startAddress)
 		{
-			YF_INFO("Unable to locate kernel symbol '%s', patch skipped.\n", patch->fname);
+			YF_INFO("Unable to locate kernel symbol '%s', table rejected.\n", patch->fname);
+			rc = -ENOENT;
 		}
-		else
+		else if (!patch->patchAddress)
 		{
-			YF_INFO("Patching kernel function '%s' at address %#010x.\n", patch->fname, (unsigned int)ptr);
-
-			for (offset = 0, patch->startAddress = ptr, ptr += patch->startOffset; offset < patch->maxOffset; offset++, ptr++)
-			{
-				value = (*ptr & patch->andMask) | patch->orMask;
-				orgValue = *(ptr + patch->patchOffset);
-
-				if (orgValue == patch->patchValue)
-				{
-					YF_INFO("Found patched instruction (%#010x) at address %#010x, looks like this patch was applied already or is not necessary.\n", orgValue, (unsigned int)(ptr + patch->patchOffset));
-					break;
-				}
-
-				if (value == patch->lookFor)
-				{
-					if (patch->verifyOffset != 0)
-					{
-						verify = (*(ptr + patch->verifyOffset) & patch->verifyAndMask) | patch->verifyOrMask;
-						if (verify != patch->verifyValue) continue;
-					}
-
-					patch->patchAddress = ptr + patch->patchOffset;
-					patch->originalValue = *(patch->patchAddress);
-					*(patch->patchAddress) = patch->patchValue;
-					patch->isPatched = 1;
-					patches_applied++;
-
-					YF_INFO("Found instruction to patch (%#010x) at address %#010x, replaced it with %#010x.\n", patch->originalValue, (unsigned int)(patch->patchAddress), *(patch->patchAddress));
-
-					break;
-				}
-			}
-
-			if (!(patch->isPatched))
-			{
-				YF_INFO("No instruction to patch found in function '%s', patch skipped.\n", patch->fname);
-			}
+			YF_INFO("No instruction to patch found in function '%s', table rejected.\n", patch->fname);
+			rc = -ENOENT;
+		}
+		else if (yf_patchkernel_is_overlapping(patches, patch))
+		{
+			YF_INFO("Instruction at address %#010x in function '%s' is patched by another entry, table rejected.\n", YF_ADDRESS(patch->patchAddress), patch->fname);
+			if (rc > 0) rc = -EEXIST;
 		}
-		patch++;
 	}
 
-	return patches_applied;
+	if (rc > 0)
+	{
+		stop_machine(yf_patchkernel_write_table, patches, NULL);
+		yf_patchkernel_flush(patches);
+		YF_INFO("%d patches from runtime table applied.\n", entries);
+	}
+
+	// a rejected table replaces the previous one, too - its statistics show the reason
+
+	kfree(runtime_patches);
+	kfree(runtime_text);
+	runtime_patches = patches;
+	runtime_text = text;
+	patches = NULL;
+	text = NULL;
+
+unlock:
+	mutex_unlock(&runtime_lock);
+
+free:
+	kfree(patches);
+	kfree(text);
+
+	return rc;
 }
 
-static void yf_patchkernel_restore(patchEntry_t *patch)
+static ssize_t yf_patchkernel_revert_write(struct file *file, const char __user *buffer, size_t count, loff_t *ppos)
 {
-	while (patch->fname)
+	mutex_lock(&runtime_lock);
+
+	if (yf_patchkernel_is_applied(runtime_patches))
 	{
-		if (patch->isPatched)
-		{
-			*(patch->patchAddress) = patch->originalValue;
-			patch->isPatched = 0;
+		stop_machine(yf_patchkernel_restore_table, runtime_patches, NULL);
+		yf_patchkernel_flush(runtime_patches);
+		yf_patchkernel_log_reverted(runtime_patches);
+		YF_INFO("Patches from runtime table reverted.\n");
+	}
 
-			YF_INFO("Reversed patch in '%s' at address %#010x to original value %#010x.\n", patch->fname, (unsigned int)(patch->patchAddress), patch->originalValue);
-		}
+	mutex_unlock(&runtime_lock);
 
-		patch++;
+	return count;
+}
+
+static void yf_patchkernel_show_table(struct seq_file *m, const char *name, patchEntry_t *patch)
+{
+	unsigned int	index;
+
+	for (index = 0; patch && patch->fname; patch++, index++)
+	{
+		seq_printf(m, "%-8s %5u %-32s 0x%08x %7u %7u %6d %7u %8u %s\n", name, index, patch->fname, (unsigned int)(patch->startAddress),
+			   patch->lookups, patch->scanned, patch->hitOffset, patch->patchCount, patch->revertCount, (patch->isPatched ? "patched" : "-"));
 	}
 }
 
+static int yf_patchkernel_status_show(struct seq_file *m, void *v)
+{
+	seq_printf(m, "%-8s %5s %-32s %-10s %7s %7s %6s %7s %8s %s\n", "table", "entry", "function", "address", "lookups", "scanned", "hit", "patched", "reverted", "state");
+
+	mutex_lock(&runtime_lock);
+	yf_patchkernel_show_table(m, "built-in", patchesForTunDevice);
+	yf_patchkernel_show_table(m, "runtime", runtime_patches);
+	mutex_unlock(&runtime_lock);
+
+	return 0;
+}
+
+static int yf_patchkernel_status_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, yf_patchkernel_status_show, NULL);
+}
+
+static const struct file_operations yf_patchkernel_table_fops = {
+	.owner = THIS_MODULE,
+	.write = yf_patchkernel_table_write,
+};
+
+static const struct file_operations yf_patchkernel_revert_fops = {
+	.owner = THIS_MODULE,
+	.write = yf_patchkernel_revert_write,
+};
+
+static const struct file_operations yf_patchkernel_status_fops = {
+	.owner = THIS_MODULE,
+	.open = yf_patchkernel_status_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int __init yf_patchkernel_init(void)
 {
 	YF_INFO("Initialization started\n");
@@ -223,6 +331,19 @@ static int __init yf_patchkernel_init(void)
 
 	YF_INFO("%u patches applied.\n", patches_applied);
 
+	debugfs_dir = debugfs_create_dir("yf_patchkernel", NULL);
+	if (IS_ERR_OR_NULL(debugfs_dir))
+	{
+		YF_INFO("Unable to create debugfs directory, runtime patch tables are not available.\n");
+		debugfs_dir = NULL;
+	}
+	else
+	{
+		debugfs_create_file("table", S_IWUSR, debugfs_dir, NULL, &yf_patchkernel_table_fops);
+		debugfs_create_file("revert", S_IWUSR, debugfs_dir, NULL, &yf_patchkernel_revert_fops);
+		debugfs_create_file("status", S_IRUSR, debugfs_dir, NULL, &yf_patchkernel_status_fops);
+	}
+
 	return 0;
 }
 
@@ -230,7 +351,19 @@ static void __exit yf_patchkernel_exit(void)
 {
 	YF_INFO("Module will be removed now.\n");
 
+	debugfs_remove_recursive(debugfs_dir);
+
+	if (yf_patchkernel_is_applied(runtime_patches))
+	{
+		stop_machine(yf_patchkernel_restore_table, runtime_patches, NULL);
+		yf_patchkernel_flush(runtime_patches);
+		yf_patchkernel_log_reverted(runtime_patches);
+	}
+	kfree(runtime_patches);
+	kfree(runtime_text);
+
 	yf_patchkernel_restore(patchesForTunDevice);
+	yf_patchkernel_flush(patchesForTunDevice);
 
 	YF_INFO("All applied patches have been reversed.\n");
 }
@@ -0,0 +1,870 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/************************************************************************************************
+ *                                                                                              *
+ * @file        yf_patchscan.c                                                                  *
+ * @brief       run the patch tables of yf_patchkernel against a kernel image in userspace      *
+ * @version     0.5                                                                             *
+ * @author      PeH                                                                             *
+ *                                                                                              *
+ ************************************************************************************************
+ *                                                                                              *
+ * Copyright (C) 2019 Peter Haemmerlein (peterpawn@yourfritz.de)                                *
+ *                                                                                              *
+ ************************************************************************************************
+ *                                                                                              *
+ * This project is free software, you can redistribute it and/or modify it under the terms of   *
+ * the GNU General Public License (version 2) as published by the Free Software Foundation.     *
+ *                                                                                              *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;    *
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.    *
+ * See the GNU General Public License under https://www.gnu.org/licenses/gpl-2.0.html for more  *
+ * details.                                                                                     *
+ *                                                                                              *
+ ************************************************************************************************
+ *                                                                                              *
+ * This program loads a MIPS kernel image (an ELF file like 'vmlinux' or an unpacked raw        *
+ * image) and runs the engine from yf_patchengine.h on a copy of the instructions. The symbols  *
+ * are read from a 'System.map' file or - if none was specified - from the kallsyms tables      *
+ * embedded into the image, the load address of a raw image is the address of '_text' then, if  *
+ * it wasn't specified. It reports the entries, which would hit, with their offsets and the     *
+ * original instructions. Instead of the built-in table, a table in text form (like it's loaded *
+ * via debugfs) may be used.                                                                    *
+ *                                                                                              *
+ * With option '-w', the patches are written to the image file, which may be used to build a    *
+ * firmware with a kernel, that doesn't need the module. Each word is checked again before it's *
+ * written, a second run will not find anything to patch anymore.                               *
+ *                                                                                              *
+ * gcc -O2 -o yf_patchscan yf_patchscan.c                                                       *
+ *                                                                                              *
+ * The offset of 'sk' in 'struct sk_buff' is 16 for the kernels used by AVM, another value may  *
+ * be specified with '-DYF_SKB_SK_OFFSET=<offset>' while compiling.                             *
+ *                                                                                              *
+ ************************************************************************************************
+*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <endian.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAX_SEGMENTS   16
+
+struct segment
+{
+	unsigned int    address;        // target address of the segment
+	unsigned int    size;           // size of data from file
+	size_t          offset;         // offset in the image file
+};
+
+struct kernelImage
+{
+	unsigned char   *data;          // the mapped image file
+	size_t          size;
+	int             fd;
+	int             isELF;
+	unsigned int    *words;         // a copy of the image in host byte order
+	size_t          count;          // number of words above
+	unsigned int    base;           // target address of the first word
+	int             bigEndian;
+	unsigned int    segmentCount;
+	struct segment  segments[MAX_SEGMENTS];
+};
+
+struct symbolMap
+{
+	char            *data;          // content of System.map (names are terminated in-place) or the expanded kallsyms names
+	unsigned int    *addresses;
+	char            **names;
+	size_t          count;
+};
+
+static struct kernelImage	image;
+static int			verbose = 0;
+
+#define YF_INFO(args...) do { if (verbose) { printf("[yf_patchscan] "); printf(args); } } while (0)
+#define YF_ADDRESS(ptr) (image.base + (unsigned int)(((unsigned int *)(ptr) - image.words) * 4))
+#define YF_FLUSH_ICACHE(first, last) do { } while (0)
+#ifndef YF_SKB_SK_OFFSET
+#define YF_SKB_SK_OFFSET 16
+#endif
+
+#include "yf_patchengine.h"
+
+static unsigned int imageWord(const unsigned char *data, int bigEndian)
+{
+	unsigned int	value;
+
+	memcpy(&value, data, sizeof(value));
+	return (bigEndian ? be32toh(value) : le32toh(value));
+}
+
+static unsigned int imageHalf(const unsigned char *data, int bigEndian)
+{
+	return (bigEndian ? (data[0] << 8) + data[1] : data[0] + (data[1] << 8));
+}
+
+// collect the PT_LOAD segments of an ELF file, they're copied to a single (sparse) image
+
+static int readELFSegments(const unsigned char *data, size_t size, struct kernelImage *kernel)
+{
+	int		bigEndian = (data[EI_DATA] == ELFDATA2MSB);
+	size_t		phoff;
+	unsigned int	phentsize;
+	unsigned int	phnum;
+	unsigned int	i;
+
+	if (data[EI_CLASS] != ELFCLASS32 || size < sizeof(Elf32_Ehdr))
+	{
+		fprintf(stderr, "Only 32-bit ELF files are supported.\n");
+		return 1;
+	}
+
+	phoff = imageWord(data + offsetof(Elf32_Ehdr, e_phoff), bigEndian);
+	phentsize = imageHalf(data + offsetof(Elf32_Ehdr, e_phentsize), bigEndian);
+	phnum = imageHalf(data + offsetof(Elf32_Ehdr, e_phnum), bigEndian);
+
+	if (phentsize < sizeof(Elf32_Phdr) || phoff + (size_t)phnum * phentsize > size)
+	{
+		fprintf(stderr, "Invalid program header table in ELF file.\n");
+		return 1;
+	}
+
+	kernel->bigEndian = bigEndian;
+
+	for (i = 0; i < phnum; i++)
+	{
+		const unsigned char	*phdr = data + phoff + i * phentsize;
+		struct segment		*segment = &(kernel->segments[kernel->segmentCount]);
+
+		if (imageWord(phdr + offsetof(Elf32_Phdr, p_type), bigEndian) != PT_LOAD) continue;
+
+		segment->address = imageWord(phdr + offsetof(Elf32_Phdr, p_vaddr), bigEndian);
+		segment->size = imageWord(phdr + offsetof(Elf32_Phdr, p_filesz), bigEndian);
+		segment->offset = imageWord(phdr + offsetof(Elf32_Phdr, p_offset), bigEndian);
+
+		if (segment->size == 0) continue;
+		if (segment->offset + segment->size > size)
+		{
+			fprintf(stderr, "ELF segment at %#010x exceeds the file size.\n", segment->address);
+			return 1;
+		}
+		if (++(kernel->segmentCount) == MAX_SEGMENTS) break;
+	}
+
+	if (kernel->segmentCount == 0)
+	{
+		fprintf(stderr, "No loadable segment found in ELF file.\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+// map the image file, for ELF files the segments are read from the program header table
+
+static int mapImage(const char *name, int bigEndian, int writable, struct kernelImage *kernel)
+{
+	struct stat	st;
+
+	memset(kernel, 0, sizeof(struct kernelImage));
+
+	if ((kernel->fd = open(name, (writable ? O_RDWR : O_RDONLY))) == -1)
+	{
+		fprintf(stderr, "Error %d opening kernel image '%s'.\n", errno, name);
+		return 1;
+	}
+
+	if (fstat(kernel->fd, &st) || st.st_size < 4 ||
+	    (kernel->data = mmap(NULL, st.st_size, PROT_READ | (writable ? PROT_WRITE : 0), (writable ? MAP_SHARED : MAP_PRIVATE), kernel->fd, 0)) == MAP_FAILED)
+	{
+		fprintf(stderr, "Error %d mapping kernel image '%s'.\n", errno, name);
+		close(kernel->fd);
+		return 1;
+	}
+	kernel->size = st.st_size;
+	kernel->bigEndian = bigEndian;
+
+	if (memcmp(kernel->data, ELFMAG, SELFMAG) == 0)
+	{
+		kernel->isELF = 1;
+		if (readELFSegments(kernel->data, kernel->size, kernel)) return 1;
+	}
+
+	return 0;
+}
+
+// copy the instructions to a buffer in host byte order, a raw image is a single segment at the load address
+
+static int buildImage(struct kernelImage *kernel, unsigned int loadAddress)
+{
+	unsigned int	first = 0xFFFFFFFF;
+	unsigned int	last = 0;
+	unsigned int	i;
+
+	if (!kernel->isELF)
+	{
+		kernel->segmentCount = 1;
+		kernel->segments[0].address = loadAddress;
+		kernel->segments[0].size = kernel->size & ~3;
+		kernel->segments[0].offset = 0;
+	}
+
+	for (i = 0; i < kernel->segmentCount; i++)
+	{
+		if (kernel->segments[i].address < first) first = kernel->segments[i].address;
+		if (kernel->segments[i].address + kernel->segments[i].size > last) last = kernel->segments[i].address + kernel->segments[i].size;
+	}
+
+	kernel->base = first & ~3;
+	kernel->count = (last - kernel->base + 3) / 4;
+	if ((kernel->words = calloc(kernel->count + 1, sizeof(unsigned int))) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the kernel image.\n", errno);
+		return 1;
+	}
+
+	for (i = 0; i < kernel->segmentCount; i++)
+	{
+		struct segment	*segment = &(kernel->segments[i]);
+		unsigned int	*word = kernel->words + (segment->address - kernel->base) / 4;
+		size_t		offset;
+
+		for (offset = 0; offset + 4 <= segment->size; offset += 4)
+			*(word++) = imageWord(kernel->data + segment->offset + offset, kernel->bigEndian);
+	}
+
+	return 0;
+}
+
+// the offset in the image file for a target address or -1, if it's not contained
+
+static long fileOffset(const struct kernelImage *kernel, unsigned int address)
+{
+	unsigned int	i;
+
+	for (i = 0; i < kernel->segmentCount; i++)
+	{
+		if (address >= kernel->segments[i].address && address - kernel->segments[i].address < kernel->segments[i].size)
+			return (long)(kernel->segments[i].offset + (address - kernel->segments[i].address));
+	}
+
+	return -1;
+}
+
+static int loadSymbols(const char *name, struct symbolMap *map)
+{
+	FILE		*file;
+	long		size;
+	char		*line;
+	char		*next;
+	size_t		lines = 0;
+
+	memset(map, 0, sizeof(struct symbolMap));
+
+	if ((file = fopen(name, "r")) == NULL)
+	{
+		fprintf(stderr, "Error %d opening symbol file '%s'.\n", errno, name);
+		return 1;
+	}
+
+	if (fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) ||
+	    (map->data = malloc(size + 1)) == NULL || fread(map->data, 1, size, file) != (size_t)size)
+	{
+		fprintf(stderr, "Error %d reading symbol file '%s'.\n", errno, name);
+		fclose(file);
+		return 1;
+	}
+	fclose(file);
+	map->data[size] = 0;
+
+	for (line = map->data; (line = strchr(line, '\n')) != NULL; line++) lines++;
+
+	map->addresses = malloc((lines + 1) * sizeof(unsigned int));
+	map->names = malloc((lines + 1) * sizeof(char *));
+	if (map->addresses == NULL || map->names == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for symbols.\n", errno);
+		return 1;
+	}
+
+	// lines look like '80012345 T symbol_name'
+
+	for (line = map->data; *line; line = next)
+	{
+		char		*symbol;
+		char		*end;
+		unsigned long	address;
+
+		if ((next = strchr(line, '\n')) != NULL)
+			*(next++) = 0;
+		else
+			next = line + strlen(line);
+
+		address = strtoul(line, &end, 16);
+		if (end == line || *end != ' ' || !end[1] || end[2] != ' ') continue;
+		symbol = end + 3;
+		if ((end = strpbrk(symbol, " \t\r")) != NULL) *end = 0;
+
+		map->addresses[map->count] = (unsigned int)address;
+		map->names[map->count] = symbol;
+		map->count++;
+	}
+
+	return 0;
+}
+
+/*
+ * the symbol tables embedded into the kernel (see scripts/kallsyms.c), each one starts at a 4-byte boundary:
+ *
+ * kallsyms_addresses   - the address of each symbol (or kallsyms_offsets and kallsyms_relative_base since version 4.6)
+ * kallsyms_num_syms    - the number of symbols
+ * kallsyms_names       - for each symbol a length byte, followed by the indexes of its tokens (the first character is the type)
+ * kallsyms_markers     - the offset in kallsyms_names of every 256th symbol
+ * kallsyms_token_table - 256 strings, each one is terminated by a NUL character
+ * kallsyms_token_index - the offset of each token in kallsyms_token_table (16 bits)
+ *
+ * They're located with a heuristic: tokens 0x30 to 0x39 are the digits, the other tables are found (and checked) from there.
+ */
+
+#define ALIGN4(x)      (((x) + 3) & ~((size_t)3))
+
+struct kallsymsTables
+{
+	size_t          addresses;      // offset of kallsyms_addresses or kallsyms_offsets
+	unsigned int    relativeBase;   // kallsyms_relative_base or 0 for absolute addresses
+	unsigned int    count;          // kallsyms_num_syms
+	size_t          names;
+	size_t          markers;
+	unsigned int    markerCount;
+	size_t          tokenTable;
+	size_t          tokenIndex;
+};
+
+static int findTokenTable(const unsigned char *data, size_t size, size_t digits, int bigEndian, struct kallsymsTables *tables)
+{
+	const unsigned char	*end;
+	size_t			position = digits;
+	size_t			start;
+	size_t			next;
+	unsigned int		i;
+
+	// tokens 0x30 to 0xFF, kallsyms_token_index follows them
+
+	for (i = 0x30; i < 256; i++)
+	{
+		if ((end = memchr(data + position, 0, size - position)) == NULL) return 1;
+		position = end - data + 1;
+	}
+
+	tables->tokenIndex = ALIGN4(position);
+	if (tables->tokenIndex + 512 > size || imageHalf(data + tables->tokenIndex, bigEndian) != 0) return 1;
+	if (imageHalf(data + tables->tokenIndex + 0x30 * 2, bigEndian) > digits) return 1;
+	tables->tokenTable = digits - imageHalf(data + tables->tokenIndex + 0x30 * 2, bigEndian);
+
+	// each token has to end right in front of the next one
+
+	for (i = 0; i < 256; i++)
+	{
+		start = tables->tokenTable + imageHalf(data + tables->tokenIndex + i * 2, bigEndian);
+		next = (i < 255 ? tables->tokenTable + imageHalf(data + tables->tokenIndex + (i + 1) * 2, bigEndian) : position);
+		if (next < start + 1 || next > position || data[next - 1] != 0 || memchr(data + start, 0, next - start - 1)) return 1;
+	}
+
+	return 0;
+}
+
+static int findMarkers(const unsigned char *data, int bigEndian, struct kallsymsTables *tables)
+{
+	size_t		position = tables->tokenTable;
+	unsigned int	previous = 0xFFFFFFFF;
+	unsigned int	value;
+
+	// the offsets are increasing and the first one is 0
+
+	for (tables->markerCount = 0; position >= 4; tables->markerCount++)
+	{
+		value = imageWord(data + position - 4, bigEndian);
+		if (value >= previous) return 1;
+		position -= 4;
+		previous = value;
+		if (value == 0) break;
+	}
+
+	if (previous != 0) return 1;
+	tables->markers = position;
+	tables->markerCount++;
+
+	return 0;
+}
+
+static int findNames(const unsigned char *data, int bigEndian, struct kallsymsTables *tables)
+{
+	unsigned int	minimum = (tables->markerCount - 1) * 256 + 1;
+	unsigned int	maximum = tables->markerCount * 256;
+	unsigned int	count;
+	unsigned int	i;
+	size_t		position;
+	size_t		name;
+
+	// look for kallsyms_num_syms in front of kallsyms_names, the names have to end at kallsyms_markers
+
+	for (position = tables->markers - 4; position >= 4 && position < tables->markers; position -= 4)
+	{
+		count = imageWord(data + position, bigEndian);
+		if (count < minimum || count > maximum) continue;
+
+		for (i = 0, name = position + 4; i < count && name < tables->markers; i++)
+		{
+			if ((i % 256) == 0 && imageWord(data + tables->markers + (i / 256) * 4, bigEndian) != name - (position + 4)) break;
+			name += data[name] + 1;
+		}
+
+		if (i == count && name <= tables->markers && ALIGN4(name) >= tables->markers)
+		{
+			tables->count = count;
+			tables->names = position + 4;
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int findAddresses(const unsigned char *data, int bigEndian, struct kallsymsTables *tables)
+{
+	size_t		numSyms = tables->names - 4;
+	size_t		table;
+	unsigned int	previous;
+	unsigned int	value;
+	unsigned int	i;
+
+	// relative offsets start with 0 (the base is the lowest address) and the base plus the last offset has to be valid
+
+	if (numSyms >= (size_t)tables->count * 4 + 4)
+	{
+		table = numSyms - 4 - (size_t)tables->count * 4;
+		tables->relativeBase = imageWord(data + numSyms - 4, bigEndian);
+
+		for (i = 0, previous = 0; i < tables->count; i++)
+		{
+			value = imageWord(data + table + i * 4, bigEndian);
+			if ((i == 0 && value != 0) || value < previous || value > 0xFFFFFFFF - tables->relativeBase) break;
+			previous = value;
+		}
+
+		if (i == tables->count)
+		{
+			tables->addresses = table;
+			return 0;
+		}
+	}
+
+	tables->relativeBase = 0;
+
+	if (numSyms < (size_t)tables->count * 4) return 1;
+	table = numSyms - (size_t)tables->count * 4;
+
+	for (i = 0, previous = 0; i < tables->count; i++)
+	{
+		value = imageWord(data + table + i * 4, bigEndian);
+		if ((i == 0 && value == 0) || value < previous) return 1;
+		previous = value;
+	}
+
+	tables->addresses = table;
+
+	return 0;
+}
+
+static int loadKallsyms(struct kernelImage *kernel, struct symbolMap *map)
+{
+	static const unsigned char	digits[] = { '0', 0, '1', 0, '2', 0, '3', 0, '4', 0, '5', 0, '6', 0, '7', 0, '8', 0, '9', 0 };
+	struct kallsymsTables		tables;
+	const unsigned char		*data = kernel->data;
+	const unsigned char		*found;
+	size_t				position = 0;
+	size_t				name;
+	size_t				length = 0;
+	char				*text;
+	unsigned int			i;
+	unsigned int			j;
+	int				bigEndian = kernel->bigEndian;
+	int				tries;
+
+	memset(map, 0, sizeof(struct symbolMap));
+
+	while ((found = memmem(data + position, kernel->size - position, digits, sizeof(digits))) != NULL)
+	{
+		position = found - data;
+
+		// the byte order of a raw image may be detected here, too
+
+		for (tries = (kernel->isELF ? 1 : 2); tries > 0; tries--, bigEndian = !bigEndian)
+		{
+			memset(&tables, 0, sizeof(tables));
+			if (findTokenTable(data, kernel->size, position, bigEndian, &tables) == 0 &&
+			    findMarkers(data, bigEndian, &tables) == 0 &&
+			    findNames(data, bigEndian, &tables) == 0 &&
+			    findAddresses(data, bigEndian, &tables) == 0)
+				break;
+		}
+		if (tries > 0) break;
+
+		bigEndian = kernel->bigEndian;
+		position++;
+	}
+
+	if (found == NULL)
+	{
+		fprintf(stderr, "Unable to locate the kallsyms tables in the kernel image.\n");
+		return 1;
+	}
+
+	if (kernel->bigEndian != bigEndian)
+	{
+		fprintf(stderr, "The kallsyms tables are stored %s endian, this byte order is used for the image.\n", (bigEndian ? "big" : "little"));
+		kernel->bigEndian = bigEndian;
+	}
+
+	// expand the names, the type character is skipped
+
+	for (i = 0, name = tables.names; i < tables.count; i++, name += data[name] + 1)
+	{
+		for (j = 1; j <= data[name]; j++)
+			length += strlen((const char *)data + tables.tokenTable + imageHalf(data + tables.tokenIndex + data[name + j] * 2, bigEndian));
+		length++;
+	}
+
+	map->data = malloc(length);
+	map->addresses = malloc(tables.count * sizeof(unsigned int));
+	map->names = malloc(tables.count * sizeof(char *));
+	if (map->data == NULL || map->addresses == NULL || map->names == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for symbols.\n", errno);
+		return 1;
+	}
+
+	for (i = 0, name = tables.names, text = map->data; i < tables.count; i++, name += data[name] + 1)
+	{
+		map->names[i] = text;
+		for (j = 1; j <= data[name]; j++)
+		{
+			const char	*token = (const char *)data + tables.tokenTable + imageHalf(data + tables.tokenIndex + data[name + j] * 2, bigEndian);
+
+			strcpy(text, token);
+			text += strlen(token);
+		}
+		*(text++) = 0;
+		if (*(map->names[i])) map->names[i]++;
+
+		map->addresses[i] = tables.relativeBase + imageWord(data + tables.addresses + i * 4, bigEndian);
+	}
+	map->count = tables.count;
+
+	if (verbose)
+		printf("Found %zu symbols in the kallsyms tables (%s addresses) at file offset %#lx.\n", map->count, (tables.relativeBase ? "relative" : "absolute"), (unsigned long)tables.addresses);
+
+	return 0;
+}
+
+// the load address of a raw image is the address of the symbol '_text' or the lowest address
+
+static unsigned int guessLoadAddress(const struct symbolMap *map)
+{
+	unsigned int	lowest = 0xFFFFFFFF;
+	size_t		i;
+
+	for (i = 0; i < map->count; i++)
+	{
+		if (strcmp(map->names[i], "_text") == 0) return map->addresses[i];
+		if (map->addresses[i] < lowest) lowest = map->addresses[i];
+	}
+
+	return lowest;
+}
+
+// resolve the symbols like kallsyms_on_each_symbol() would do it, only symbols within the image are used
+
+static size_t resolveSymbols(patchEntry_t *patches, const struct symbolMap *map)
+{
+	size_t		i;
+
+	for (i = 0; i < map->count; i++)
+	{
+		unsigned int	address = map->addresses[i];
+
+		if (address < image.base || (address - image.base) / 4 >= image.count || (address & 3)) continue;
+		if (yf_patchkernel_resolve(patches, map->names[i], (unsigned long)(image.words + (address - image.base) / 4))) return i + 1;
+	}
+
+	return map->count;
+}
+
+// the engine reads behind the search window (verification and patch offsets), these words have to exist
+
+static void checkBounds(patchEntry_t *patch)
+{
+	for (; patch->fname; patch++)
+	{
+		size_t		last;
+
+		if (!(patch->startAddress)) continue;
+
+		last = (size_t)(patch->startAddress - image.words) + patch->startOffset + patch->maxOffset;
+		last += (patch->verifyOffset > patch->patchOffset ? patch->verifyOffset : patch->patchOffset);
+		if (last > image.count)
+		{
+			fprintf(stderr, "Search window for '%s' exceeds the kernel image, patch skipped.\n", patch->fname);
+			patch->startAddress = NULL;
+		}
+	}
+}
+
+// load a patch table in text form (see yf_patchkernel_parse), it's used instead of the built-in table
+
+static patchEntry_t *loadTable(const char *name)
+{
+	FILE		*file;
+	long		size;
+	char		*text;
+	patchEntry_t	*patches;
+	int		entries;
+
+	if ((file = fopen(name, "r")) == NULL)
+	{
+		fprintf(stderr, "Error %d opening patch table '%s'.\n", errno, name);
+		return NULL;
+	}
+
+	if (fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) ||
+	    (text = malloc(size + 1)) == NULL || fread(text, 1, size, file) != (size_t)size)
+	{
+		fprintf(stderr, "Error %d reading patch table '%s'.\n", errno, name);
+		fclose(file);
+		return NULL;
+	}
+	fclose(file);
+	text[size] = 0;
+
+	if ((patches = calloc(yf_patchkernel_lines(text) + 1, sizeof(patchEntry_t))) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the patch table.\n", errno);
+		return NULL;
+	}
+
+	if ((entries = yf_patchkernel_parse(text, patches)) <= 0)
+	{
+		if (entries < 0)
+			fprintf(stderr, "Invalid entry in line %d of patch table '%s'.\n", -entries, name);
+		else
+			fprintf(stderr, "Patch table '%s' is empty.\n", name);
+		return NULL;
+	}
+
+	return patches;
+}
+
+static void report(patchEntry_t *patch)
+{
+	unsigned int	index;
+
+	printf("%-5s %-32s %-10s %-7s %-6s %-10s %-10s %-10s %s\n", "entry", "function", "address", "scanned", "offset", "patch at", "file offs", "original", "patched");
+
+	for (index = 0; patch->fname; patch++, index++)
+	{
+		printf("%-5u %-32s ", index, patch->fname);
+
+		if (!(patch->startAddress))
+		{
+			printf("symbol not found\n");
+			continue;
+		}
+
+		printf("0x%08x %-7u ", YF_ADDRESS(patch->startAddress), patch->scanned);
+
+		if (!(patch->isPatched))
+		{
+			printf("no hit\n");
+			continue;
+		}
+
+		printf("%-6d 0x%08x 0x%08lx 0x%08x 0x%08x\n", patch->hitOffset,
+		       YF_ADDRESS(patch->patchAddress), fileOffset(&image, YF_ADDRESS(patch->patchAddress)), patch->originalValue, patch->patchValue);
+	}
+}
+
+// write the applied patches to the mapped image file, the original value is checked again for each word
+
+static int writePatches(patchEntry_t *patch)
+{
+	unsigned int	value;
+	long		offset;
+	int		written = 0;
+
+	for (; patch->fname; patch++)
+	{
+		if (!(patch->isPatched)) continue;
+
+		offset = fileOffset(&image, YF_ADDRESS(patch->patchAddress));
+		if (offset < 0 || (size_t)offset + 4 > image.size || imageWord(image.data + offset, image.bigEndian) != patch->originalValue)
+		{
+			fprintf(stderr, "Unexpected content at address %#010x, patch for '%s' not written.\n", YF_ADDRESS(patch->patchAddress), patch->fname);
+			continue;
+		}
+
+		value = (image.bigEndian ? htobe32(patch->patchValue) : htole32(patch->patchValue));
+		memcpy(image.data + offset, &value, sizeof(value));
+		written++;
+	}
+
+	if (msync(image.data, image.size, MS_SYNC))
+	{
+		fprintf(stderr, "Error %d writing kernel image.\n", errno);
+		return -1;
+	}
+
+	return written;
+}
+
+static void benchmark(patchEntry_t *patches, const struct symbolMap *map, unsigned int rounds)
+{
+	struct timespec	start;
+	struct timespec	end;
+	patchEntry_t	*patch;
+	size_t		symbols = 0;
+	size_t		scanned = 0;
+	unsigned int	round;
+	double		seconds;
+
+	verbose = 0;
+
+	for (patch = patches; patch->fname; patch++) scanned -= patch->scanned;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (round = 0; round < rounds; round++)
+	{
+		yf_patchkernel_restore(patches);
+		yf_patchkernel_reset(patches);
+		symbols += resolveSymbols(patches, map);
+		checkBounds(patches);
+		yf_patchkernel_process(patches);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for (patch = patches; patch->fname; patch++) scanned += patch->scanned;
+
+	seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("\n%u rounds in %.3f seconds, %.1f us per round, %.1f million symbols per second, %zu instructions compared per round\n",
+	       rounds, seconds, seconds * 1e6 / rounds, (seconds > 0 ? symbols / seconds / 1e6 : 0.0), scanned / rounds);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [ -v ] [ -w ] [ -t <table> ] [ -b <rounds> ] [ -a <load_address> ] [ -l ] <kernel_image> [ <System.map> ]\n\n", name);
+	fprintf(stderr, "-v  show the messages of the patch engine\n");
+	fprintf(stderr, "-w  write the patches to the kernel image file\n");
+	fprintf(stderr, "-t  use the patch table from the specified file (text form, like it's written to debugfs)\n");
+	fprintf(stderr, "-b  run a benchmark with the specified number of rounds (symbol resolution and scan)\n");
+	fprintf(stderr, "-a  the load address of a raw image (default is the address of '_text')\n");
+	fprintf(stderr, "-l  a raw image is little endian (default is big endian)\n\n");
+	fprintf(stderr, "Without a System.map file, the symbols are read from the kallsyms tables in the image.\n\n");
+}
+
+int main(int argc, char * argv[])
+{
+	struct symbolMap	map;
+	patchEntry_t		*patches = patchesForTunDevice;
+	unsigned int		loadAddress = 0;
+	unsigned int		rounds = 0;
+	int			bigEndian = 1;
+	int			writable = 0;
+	int			written;
+	int			opt;
+
+	while ((opt = getopt(argc, argv, "vwt:b:a:lh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'v':
+				verbose = 1;
+				break;
+
+			case 'w':
+				writable = 1;
+				break;
+
+			case 't':
+				if ((patches = loadTable(optarg)) == NULL) exit(1);
+				break;
+
+			case 'b':
+				rounds = strtoul(optarg, NULL, 10);
+				break;
+
+			case 'a':
+				loadAddress = strtoul(optarg, NULL, 16);
+				break;
+
+			case 'l':
+				bigEndian = 0;
+				break;
+
+			default:
+				usage(argv[0]);
+				exit(opt == 'h' ? 0 : 1);
+		}
+	}
+
+	if (argc - optind < 1 || argc - optind > 2)
+	{
+		usage(argv[0]);
+		exit(1);
+	}
+
+	if (mapImage(argv[optind], bigEndian, writable, &image)) exit(1);
+
+	if (argc - optind == 2)
+	{
+		if (loadSymbols(argv[optind + 1], &map)) exit(1);
+	}
+	else
+	{
+		if (loadKallsyms(&image, &map)) exit(1);
+	}
+
+	if (!image.isELF && loadAddress == 0)
+	{
+		loadAddress = guessLoadAddress(&map);
+		fprintf(stderr, "Using load address %#010x for the raw image.\n", loadAddress);
+	}
+
+	if (buildImage(&image, loadAddress)) exit(1);
+
+	yf_patchkernel_reset(patches);
+	resolveSymbols(patches, &map);
+	checkBounds(patches);
+	yf_patchkernel_process(patches);
+
+	report(patches);
+
+	if (writable)
+	{
+		if ((written = writePatches(patches)) < 0) exit(1);
+		printf("\n%d patches written to '%s'.\n", written, argv[optind]);
+	}
+
+	if (rounds) benchmark(patches, &map, rounds);
+
+	exit(0);
+}
@@ -0,0 +1,832 @@
+/* dissect a TFFS dump into its nodes and build TFFS images */
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * This is a native replacement for the 'dissect_tffs_dump' script, which creates the same files in a new
+ * folder '$TMP/tmp_<time>_<pid>':
+ *
+ * - '<id>.bin' contains the data of each node (with the ID as four lowercase hexadecimal digits)
+ * - '<id>.inflated' contains the inflated data of the nodes with IDs from 2 to 255
+ * - 'nametable.txt' contains the name table from node 0x01FF as lines "<id> <name>"
+ * - 'nodelist' contains a line "NODE=<id> OFFSET=<offset> LENGTH=<length>" for each node
+ *
+ * The dump is read from the specified file or from STDIN and processed in a single pass, the name of the
+ * folder is written to STDOUT. Other than the script, no copy of the dump is stored in the folder.
+ *
+ * TFFS entries are built of:
+ *
+ * offset length meaning
+ *    0      2   node ID (big endian)
+ *    2      2   length of data following this header (big endian)
+ *    4      n   data for this entry
+ *
+ * Each entry is aligned on the next 4-byte boundary, the ID 0xFFFF marks the end of the used area.
+ *
+ * The 'build' and 'nametable' modes replace the 'build_tffs_image' script (with 'nametable_to_tffs',
+ * 'environment_to_tffs' and 'counter_to_tffs') and 'nametable_to_tffs' alone. The image is built in memory
+ * and its content is byte-identical to the one from the scripts. With 'build -z', files with the suffix
+ * '.inflated' (as written by 'dissect') are deflated again, the scripts have no equivalent for this.
+ *
+ * gcc -O2 -o tffs_image tffs_image.c -lz
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#define READ_BUFFER_SIZE		(256 * 1024)
+#define INFLATE_BUFFER_SIZE		(64 * 1024)
+#define OUTPUT_BUFFER_SIZE		(64 * 1024)
+
+#define TFFS_ID_END				0xFFFF
+#define TFFS_ID_NAMETABLE		0x01FF
+#define TFFS_MAX_LENGTH			0xFFFF
+
+/* input data - mapped from a file or read from a pipe */
+struct inputData
+{
+	uint8_t *		data;
+	size_t			size;
+	int				mapped;
+};
+
+static int loadInput(const char *name, struct inputData *input)
+{
+	struct stat		st;
+	ssize_t			readBytes;
+	size_t			allocated = 0;
+	int				fd = 0;
+
+	memset(input, 0, sizeof(struct inputData));
+
+	if (name != NULL && (fd = open(name, O_RDONLY)) == -1)
+	{
+		fprintf(stderr, "Error %d opening file '%s'.\n", errno, name);
+		return 1;
+	}
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		if ((input->data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED)
+		{
+			input->size = st.st_size;
+			input->mapped = 1;
+			if (fd) close(fd);
+			return 0;
+		}
+		input->data = NULL;
+	}
+
+	while (1)
+	{
+		if (input->size == allocated)
+		{
+			uint8_t *	data;
+
+			allocated = (allocated ? allocated * 2 : READ_BUFFER_SIZE);
+			if ((data = realloc(input->data, allocated)) == NULL)
+			{
+				fprintf(stderr, "Error %d allocating memory for the input data.\n", errno);
+				free(input->data);
+				if (fd) close(fd);
+				return 1;
+			}
+			input->data = data;
+		}
+
+		if ((readBytes = read(fd, input->data + input->size, allocated - input->size)) == 0) break;
+		if (readBytes == -1)
+		{
+			if (errno == EINTR) continue;
+			fprintf(stderr, "Error %d reading input data.\n", errno);
+			free(input->data);
+			if (fd) close(fd);
+			return 1;
+		}
+		input->size += readBytes;
+	}
+
+	if (fd) close(fd);
+	return 0;
+}
+
+static void releaseInput(struct inputData *input)
+{
+	if (input->mapped)
+		munmap(input->data, input->size);
+	else
+		free(input->data);
+}
+
+static FILE * createFile(const char *folder, const char *name, const char *mode)
+{
+	char			path[PATH_MAX];
+	FILE *			file;
+
+	if (snprintf(path, sizeof(path), "%s/%s", folder, name) >= (int) sizeof(path))
+	{
+		fprintf(stderr, "Path name for file '%s' is too long.\n", name);
+		return NULL;
+	}
+
+	if ((file = fopen(path, mode)) == NULL)
+	{
+		fprintf(stderr, "Error %d opening file '%s'.\n", errno, path);
+		return NULL;
+	}
+
+	return file;
+}
+
+static int closeFile(FILE *file, const char *name)
+{
+	if (ferror(file) | fclose(file))
+	{
+		fprintf(stderr, "Error %d writing file '%s'.\n", errno, name);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int writeFile(const char *folder, const char *name, const uint8_t *data, size_t size)
+{
+	FILE *			file;
+
+	if ((file = createFile(folder, name, "w")) == NULL) return 1;
+	fwrite(data, 1, size, file);
+
+	return closeFile(file, name);
+}
+
+static int isHexDigit(uint8_t digit)
+{
+	return ((digit >= '0' && digit <= '9') || (digit >= 'A' && digit <= 'F') || (digit >= 'a' && digit <= 'f'));
+}
+
+static uint16_t getBE16(const uint8_t *data)
+{
+	return (data[0] << 8) | data[1];
+}
+
+static uint32_t getBE32(const uint8_t *data)
+{
+	return ((uint32_t) data[0] << 24) | ((uint32_t) data[1] << 16) | ((uint32_t) data[2] << 8) | data[3];
+}
+
+/*
+ * The script prepended a gzip header without the last two bytes (XFL and OS) and those were taken from the
+ * zlib header of the node, so the deflated data starts at offset 2 and the zlib trailer is never checked.
+ * Anything inflated until an error occurs is written, like 'gzip -dc 2>/dev/null' did it.
+ */
+static int inflateNode(const char *folder, const char *name, const uint8_t *data, size_t size)
+{
+	uint8_t			buffer[INFLATE_BUFFER_SIZE];
+	z_stream		stream;
+	FILE *			file;
+	int				zrc = Z_OK;
+
+	if ((file = createFile(folder, name, "w")) == NULL) return 1;
+
+	memset(&stream, 0, sizeof(stream));
+	if (size > 2 && inflateInit2(&stream, -MAX_WBITS) == Z_OK)
+	{
+		stream.next_in = (Bytef *) data + 2;
+		stream.avail_in = size - 2;
+
+		while (zrc == Z_OK)
+		{
+			stream.next_out = buffer;
+			stream.avail_out = sizeof(buffer);
+			zrc = inflate(&stream, Z_NO_FLUSH);
+			fwrite(buffer, 1, sizeof(buffer) - stream.avail_out, file);
+			if (zrc == Z_BUF_ERROR && stream.avail_out == 0) zrc = Z_OK;
+		}
+		inflateEnd(&stream);
+	}
+
+	return closeFile(file, name);
+}
+
+/* entries are a 32-bit ID and a NUL terminated name, the next one starts at a 4-byte boundary */
+static int writeNameTable(const char *folder, const uint8_t *data, size_t size, int debug)
+{
+	FILE *			file;
+	size_t			offset = 0;
+
+	if ((file = createFile(folder, "nametable.txt", "w")) == NULL) return 1;
+
+	while (offset < size)
+	{
+		size_t			start = offset;
+		uint32_t		id = 0;
+		const uint8_t *	name;
+		const uint8_t *	end;
+		size_t			length;
+
+		if (size - offset >= 4) id = getBE32(data + offset);
+		offset += 4;
+		if (offset > size) offset = size;
+
+		name = data + offset;
+		end = memchr(name, 0, size - offset);
+		length = (end ? (size_t) (end - name) : size - offset);
+		offset = (offset + length + 1 + 3) & ~((size_t) 3);
+
+		if (debug) fprintf(stderr, "offset=%zu id=%" PRIu32 " name=%.*s\n", start, id, (int) length, name);
+		fprintf(file, "%" PRIu32 " %.*s\n", id, (int) length, name);
+	}
+
+	return closeFile(file, "nametable.txt");
+}
+
+static int dissect(const char *inputName, int debug)
+{
+	struct inputData	input;
+	char				folder[PATH_MAX];
+	char				name[32];
+	const char *		tmp = getenv("TMP");
+	FILE *				nodelist = NULL;
+	uint8_t *			seen;
+	size_t				offset = 0;
+	int					rc = 1;
+
+	if (loadInput(inputName, &input)) return 1;
+
+	if ((seen = calloc(65536, 1)) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory.\n", errno);
+		releaseInput(&input);
+		return 1;
+	}
+
+	if (tmp == NULL || *tmp == 0) tmp = "/tmp";
+	if (snprintf(folder, sizeof(folder), "%s/tmp_%lu_%lu", tmp, (unsigned long) time(NULL), (unsigned long) getpid()) >= (int) sizeof(folder) ||
+		mkdir(folder, 0777) == -1)
+	{
+		fprintf(stderr, "Error %d creating temporary folder.\n", errno);
+		goto exit;
+	}
+
+	if ((nodelist = createFile(folder, "nodelist", "w")) == NULL) goto exit;
+
+	while (1)
+	{
+		const uint8_t *	node = input.data + offset;
+		uint16_t		id;
+		size_t			length;
+		size_t			available;
+
+		if (offset + 2 > input.size || (offset + 4 > input.size && getBE16(node) != TFFS_ID_END))
+		{
+			fprintf(stderr, "unexpected error reading TFFS dump\n");
+			goto exit;
+		}
+
+		/* end of used area reached */
+		if ((id = getBE16(node)) == TFFS_ID_END) break;
+
+		length = getBE16(node + 2);
+		available = input.size - offset - 4;
+		if (available > length) available = length;
+
+		if (id != 0)
+		{
+			if (seen[id])
+				fprintf(stderr, "unexpected duplicate entry found for id 0x%04x\n", id);
+			else
+			{
+				seen[id] = 1;
+
+				snprintf(name, sizeof(name), "%04x.bin", id);
+				if (writeFile(folder, name, node + 4, available)) goto exit;
+
+				if (id == TFFS_ID_NAMETABLE)
+				{
+					if (writeNameTable(folder, node + 4, available, debug)) goto exit;
+					fprintf(nodelist, "NODE=%u OFFSET=%zu LENGTH=%zu - this is the name table\n", id, offset, length);
+					if (debug) fprintf(stderr, "NODE=%u OFFSET=%zu LENGTH=%zu - this is the name table\n", id, offset, length);
+				}
+				else
+				{
+					if (id > 1 && id < 256)
+					{
+						snprintf(name, sizeof(name), "%04x.inflated", id);
+						if (inflateNode(folder, name, node + 4, available)) goto exit;
+					}
+					fprintf(nodelist, "NODE=%u OFFSET=%zu LENGTH=%zu\n", id, offset, length);
+					if (debug) fprintf(stderr, "NODE=%u OFFSET=%zu LENGTH=%zu\n", id, offset, length);
+				}
+			}
+		}
+
+		offset += 4 + ((length + 3) & ~((size_t) 3));
+	}
+
+	rc = closeFile(nodelist, "nodelist");
+	nodelist = NULL;
+	if (rc == 0) printf("%s\n", folder);
+
+exit:
+	if (nodelist) fclose(nodelist);
+	free(seen);
+	releaseInput(&input);
+	return rc;
+}
+
+/* the image is built in memory and written at once */
+struct outputBuffer
+{
+	uint8_t *		data;
+	size_t			size;
+	size_t			allocated;
+	int				failed;
+};
+
+static void appendData(struct outputBuffer *output, const void *data, size_t size)
+{
+	if (output->failed) return;
+
+	if (output->size + size > output->allocated)
+	{
+		size_t		allocated = (output->allocated ? output->allocated : OUTPUT_BUFFER_SIZE);
+		uint8_t *	buffer;
+
+		while (allocated < output->size + size) allocated *= 2;
+		if ((buffer = realloc(output->data, allocated)) == NULL)
+		{
+			fprintf(stderr, "Error %d allocating memory for the image.\n", errno);
+			output->failed = 1;
+			return;
+		}
+		output->data = buffer;
+		output->allocated = allocated;
+	}
+
+	if (data)
+		memcpy(output->data + output->size, data, size);
+	else
+		memset(output->data + output->size, 0, size);
+	output->size += size;
+}
+
+static void appendBE(struct outputBuffer *output, uint32_t value, size_t size)
+{
+	uint8_t			bytes[4];
+	size_t			i;
+
+	for (i = 0; i < size; i++) bytes[i] = value >> ((size - 1 - i) * 8);
+	appendData(output, bytes, size);
+}
+
+/* a node with its header, the data is padded with zeros up to the next 4-byte boundary */
+static void appendNode(struct outputBuffer *output, uint16_t id, const void *data, size_t size)
+{
+	if (size > TFFS_MAX_LENGTH)
+	{
+		fprintf(stderr, "The data of node 0x%04x is too large (%zu bytes).\n", id, size);
+		output->failed = 1;
+		return;
+	}
+
+	appendBE(output, id, 2);
+	appendBE(output, size, 2);
+	appendData(output, data, size);
+	appendData(output, NULL, ((size + 3) & ~((size_t) 3)) - size);
+}
+
+/*
+ * text files are processed like the scripts did it with 'while read', a last line without a newline
+ * character is ignored - otherwise the output wouldn't be identical
+ */
+static const uint8_t * nextLine(const struct inputData *input, const uint8_t **line, size_t *length)
+{
+	const uint8_t *	end = input->data + input->size;
+	const uint8_t *	eol;
+
+	if (*line >= end || (eol = memchr(*line, '\n', end - *line)) == NULL) return NULL;
+	*length = eol - *line;
+
+	return eol + 1;
+}
+
+static int isBlank(uint8_t character)
+{
+	return (character == ' ' || character == '\t');
+}
+
+static int isDecimal(const uint8_t *value, size_t length)
+{
+	while (length--)
+	{
+		if (*value < '0' || *value > '9') return 0;
+		value++;
+	}
+	return 1;
+}
+
+/* a decimal number without any sign, returns 0 if it's empty or greater than the specified maximum */
+static int decimalValue(const uint8_t *value, size_t length, unsigned long maximum, unsigned long *result)
+{
+	*result = 0;
+	if (length == 0) return 0;
+
+	while (length--)
+	{
+		if (*value < '0' || *value > '9' || *result > (maximum - (*value - '0')) / 10) return 0;
+		*result = *result * 10 + (*value - '0');
+		value++;
+	}
+
+	return 1;
+}
+
+/* the name table node, each line contains the ID and the name */
+static int appendNameTable(struct outputBuffer *output, const struct inputData *nameTable)
+{
+	struct outputBuffer	node;
+	const uint8_t *		line = nameTable->data;
+	const uint8_t *		next;
+	size_t				length;
+
+	memset(&node, 0, sizeof(node));
+
+	for (; (next = nextLine(nameTable, &line, &length)) != NULL; line = next)
+	{
+		const uint8_t *	id;
+		const uint8_t *	name;
+		size_t			idLength;
+		size_t			nameLength;
+		unsigned long	value;
+
+		while (length > 0 && isBlank(*line)) { line++; length--; }
+		while (length > 0 && isBlank(line[length - 1])) length--;
+		if (length == 0) continue;
+
+		for (id = line, idLength = 0; idLength < length && !isBlank(id[idLength]); idLength++);
+		for (name = id + idLength, nameLength = length - idLength; nameLength > 0 && isBlank(*name); name++, nameLength--);
+
+		if (!isDecimal(id, idLength))
+		{
+			fprintf(stderr, "invalid name table entry '%.*s' ignored\n", (int) length, line);
+			continue;
+		}
+
+		if (!decimalValue(id, idLength, UINT32_MAX, &value))
+		{
+			fprintf(stderr, "The ID of name table entry '%.*s' is out of range.\n", (int) length, line);
+			node.failed = 1;
+			break;
+		}
+
+		appendBE(&node, value, 4);
+		appendData(&node, name, nameLength);
+		appendData(&node, NULL, ((nameLength + 1 + 3) & ~((size_t) 3)) - nameLength);
+	}
+
+	if (node.size > TFFS_MAX_LENGTH && !node.failed)
+	{
+		fprintf(stderr, "The name table is too large (%zu bytes).\n", node.size);
+		node.failed = 1;
+	}
+
+	/* the name table isn't padded, its entries are aligned already */
+	appendBE(output, TFFS_ID_NAMETABLE, 2);
+	appendBE(output, node.size, 2);
+	appendData(output, node.data, node.size);
+	if (node.failed) output->failed = 1;
+	free(node.data);
+
+	return output->failed;
+}
+
+/* find '^[0-9]*[ \t]*<name>$' in the name table and return its (non-empty) ID */
+static int lookupName(const struct inputData *nameTable, const uint8_t *name, size_t nameLength, unsigned long *id)
+{
+	const uint8_t *	line = nameTable->data;
+	const uint8_t *	end = nameTable->data + nameTable->size;
+
+	while (line < end)
+	{
+		const uint8_t *	eol = memchr(line, '\n', end - line);
+		const uint8_t *	value;
+		size_t			digits;
+		size_t			length;
+
+		if (eol == NULL) eol = end;
+		length = eol - line;
+
+		for (digits = 0; digits < length && line[digits] >= '0' && line[digits] <= '9'; digits++);
+		for (value = line + digits; value < eol && isBlank(*value); value++);
+
+		if (digits > 0 && (size_t) (eol - value) == nameLength && memcmp(value, name, nameLength) == 0)
+		{
+			if (!decimalValue(line, digits, ULONG_MAX, id)) *id = ULONG_MAX;
+			return 1;
+		}
+
+		line = eol + 1;
+	}
+
+	return 0;
+}
+
+/* the environment nodes, each line contains the name and the value - separated by blanks */
+static int appendEnvironment(struct outputBuffer *output, const struct inputData *nameTable, const struct inputData *environment)
+{
+	const uint8_t *		line = environment->data;
+	const uint8_t *		next;
+	size_t				length;
+
+	for (; (next = nextLine(environment, &line, &length)) != NULL; line = next)
+	{
+		const uint8_t *	value;
+		size_t			nameLength;
+		size_t			valueLength;
+		size_t			nodeStart;
+		unsigned long	id;
+
+		if (length > 0 && line[length - 1] == '\r') length--;
+		for (nameLength = 0; nameLength < length && !isBlank(line[nameLength]); nameLength++);
+		for (value = line + nameLength; value < line + length && isBlank(*value); value++);
+
+		if (!lookupName(nameTable, line, nameLength, &id))
+		{
+			fprintf(stderr, "name table entry for '%.*s' not found, value ignored\n", (int) nameLength, line);
+			continue;
+		}
+
+		if (id >= TFFS_ID_END)
+		{
+			fprintf(stderr, "The ID of name table entry '%.*s' is out of range for an environment node.\n", (int) nameLength, line);
+			output->failed = 1;
+			break;
+		}
+
+		/* the terminating NUL character is part of the value, 'eval $line' replaced each run of blanks by a space */
+		appendBE(output, id, 2);
+		nodeStart = output->size;
+		appendBE(output, 0, 2);
+		for (valueLength = 0; value < line + length; value++)
+		{
+			if (isBlank(*value))
+			{
+				if (valueLength > 0 && isBlank(value[-1])) continue;
+				appendData(output, " ", 1);
+			}
+			else
+				appendData(output, value, 1);
+			valueLength++;
+		}
+		appendData(output, NULL, ((valueLength + 1 + 3) & ~((size_t) 3)) - valueLength);
+		if (output->failed) break;
+		if (valueLength + 1 > TFFS_MAX_LENGTH)
+		{
+			fprintf(stderr, "The value of '%.*s' is too long (%zu bytes).\n", (int) nameLength, line, valueLength + 1);
+			output->failed = 1;
+			break;
+		}
+		output->data[nodeStart] = (valueLength + 1) >> 8;
+		output->data[nodeStart + 1] = (valueLength + 1);
+	}
+
+	return output->failed;
+}
+
+/* the counters are stored as a bit mask with (-1 << <value>), little endian */
+static const struct
+{
+	const char *	name;
+	uint16_t		id;
+	size_t			size;
+} counters[] = {
+	{ "run_years", 0x0405, 4 },
+	{ "run_hours", 0x0402, 4 },
+	{ "run_days", 0x0403, 4 },
+	{ "run_mounths", 0x0404, 4 },		/* sic! */
+	{ "reboot_major", 0x0400, 8 },
+	{ "reboot_minor", 0x0401, 4 },
+};
+
+#define COUNTERS_COUNT			(sizeof(counters) / sizeof(counters[0]))
+
+static int appendCounters(struct outputBuffer *output, const struct inputData *counterFile)
+{
+	uint64_t			values[COUNTERS_COUNT];
+	const uint8_t *		line = counterFile->data;
+	const uint8_t *		next;
+	size_t				length;
+	size_t				i;
+
+	for (i = 0; i < COUNTERS_COUNT; i++) values[i] = UINT64_MAX;
+
+	for (; (next = nextLine(counterFile, &line, &length)) != NULL; line = next)
+	{
+		const uint8_t *	value;
+		size_t			nameLength;
+		unsigned int	shift = 0;
+
+		if (length > 0 && line[length - 1] == '\r') length--;
+		for (nameLength = 0; nameLength < length && line[nameLength] != ' '; nameLength++);
+		for (value = line + nameLength; value < line + length && *value == ' '; value++);
+
+		/* some devices (e.g. 6490) return strange values, the shell used only the lowest 6 bits of the shift count */
+		if (isDecimal(value, line + length - value))
+		{
+			for (; value < line + length; value++) shift = (shift * 10 + (*value - '0')) & 63;
+		}
+
+		for (i = 0; i < COUNTERS_COUNT; i++)
+		{
+			if (strlen(counters[i].name) == nameLength && memcmp(counters[i].name, line, nameLength) == 0) break;
+		}
+
+		if (i == COUNTERS_COUNT)
+			fprintf(stderr, "unknown name '%.*s' found in counter file\n", (int) nameLength, line);
+		else
+			values[i] = UINT64_MAX << shift;
+	}
+
+	for (i = 0; i < COUNTERS_COUNT; i++)
+	{
+		uint8_t			bytes[8];
+		size_t			j;
+
+		for (j = 0; j < counters[i].size; j++) bytes[j] = values[i] >> (j * 8);
+		appendNode(output, counters[i].id, bytes, counters[i].size);
+	}
+
+	return output->failed;
+}
+
+/*
+ * additional files are named after their node ID as four hexadecimal digits (with any suffix), the content
+ * is stored unchanged - if 'deflate' is set, files with the suffix '.inflated' are deflated first
+ */
+static int appendFile(struct outputBuffer *output, const char *name, int deflate)
+{
+	struct inputData	file;
+	const char *		base = strrchr(name, '/');
+	const char *		suffix;
+	int					rc = 0;
+	size_t				i;
+
+	base = (base ? base + 1 : name);
+	suffix = strchr(base, '.');
+
+	for (i = 0; i < 4 && isHexDigit(base[i]); i++);
+	if (i != 4 || (base[4] != 0 && base[4] != '.') || strtoul(base, NULL, 16) == TFFS_ID_END)
+	{
+		fprintf(stderr, "The name of file '%s' isn't a valid node ID.\n", name);
+		return 1;
+	}
+
+	if (loadInput(name, &file)) return 1;
+
+	if (deflate && suffix && strcmp(suffix, ".inflated") == 0)
+	{
+		uLongf			size = compressBound(file.size);
+		uint8_t *		deflated = malloc(size);
+
+		if (deflated == NULL || compress2(deflated, &size, file.data, file.size, Z_DEFAULT_COMPRESSION) != Z_OK)
+		{
+			fprintf(stderr, "Error deflating file '%s'.\n", name);
+			rc = 1;
+		}
+		else
+			appendNode(output, strtoul(base, NULL, 16), deflated, size);
+		free(deflated);
+	}
+	else
+		appendNode(output, strtoul(base, NULL, 16), file.data, file.size);
+
+	releaseInput(&file);
+	return (rc | output->failed);
+}
+
+static int writeOutput(const struct outputBuffer *output)
+{
+	const uint8_t *		data = output->data;
+	size_t				size = output->size;
+	ssize_t				written;
+
+	while (size > 0)
+	{
+		if ((written = write(1, data, size)) == -1)
+		{
+			if (errno == EINTR) continue;
+			fprintf(stderr, "Error %d writing the image.\n", errno);
+			return 1;
+		}
+		data += written;
+		size -= written;
+	}
+
+	return 0;
+}
+
+static int build(const char *nameTableName, const char *environmentName, const char *counterName, char **files, int fileCount, int deflate)
+{
+	static const uint8_t	segmentHeader[] = { 0x00, 0x01, 0x00, 0x04, 0xFF, 0xFF, 0xFF, 0xFE };
+	struct outputBuffer		output;
+	struct inputData		nameTable;
+	struct inputData		environment;
+	struct inputData		counterFile;
+	int						rc = 1;
+	int						i;
+
+	memset(&output, 0, sizeof(output));
+
+	if (loadInput(nameTableName, &nameTable)) return 1;
+	if (loadInput(environmentName, &environment))
+	{
+		releaseInput(&nameTable);
+		return 1;
+	}
+	if (loadInput(counterName, &counterFile))
+	{
+		releaseInput(&environment);
+		releaseInput(&nameTable);
+		return 1;
+	}
+
+	/* segment header with the earliest version, it's incremented with each new version written to TFFS */
+	appendData(&output, segmentHeader, sizeof(segmentHeader));
+
+	if (appendNameTable(&output, &nameTable)) goto exit;
+	if (appendEnvironment(&output, &nameTable, &environment)) goto exit;
+	if (appendCounters(&output, &counterFile)) goto exit;
+
+	for (i = 0; i < fileCount; i++)
+	{
+		if (appendFile(&output, files[i], deflate)) goto exit;
+	}
+
+	appendBE(&output, TFFS_ID_END, 2);
+	if (!output.failed) rc = writeOutput(&output);
+
+exit:
+	free(output.data);
+	releaseInput(&counterFile);
+	releaseInput(&environment);
+	releaseInput(&nameTable);
+	return rc;
+}
+
+/* the name table node only, like 'nametable_to_tffs' */
+static int nametable(const char *nameTableName)
+{
+	struct outputBuffer		output;
+	struct inputData		nameTable;
+	int						rc = 1;
+
+	memset(&output, 0, sizeof(output));
+
+	if (loadInput(nameTableName, &nameTable)) return 1;
+	if (appendNameTable(&output, &nameTable) == 0) rc = writeOutput(&output);
+
+	free(output.data);
+	releaseInput(&nameTable);
+	return rc;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s dissect [ -d ] [ <dump> ]\n", name);
+	fprintf(stderr, "       %s build [ -z ] <name_table> <environment> <counters> [ <file> ... ]\n", name);
+	fprintf(stderr, "       %s nametable [ <name_table> ]\n\n", name);
+	fprintf(stderr, "'dissect' splits a TFFS dump (from the specified file or from STDIN) into its nodes, the name of\n");
+	fprintf(stderr, "the created folder is written to STDOUT. With '-d', the nodes are listed on STDERR, too.\n");
+	fprintf(stderr, "'build' writes a TFFS image with the name table, the environment, the counters and the specified\n");
+	fprintf(stderr, "files (named after their node ID, e.g. '001d.bin') to STDOUT. The files are stored unchanged, with\n");
+	fprintf(stderr, "'-z' files with the suffix '.inflated' (as written by 'dissect') are deflated first.\n");
+	fprintf(stderr, "'nametable' writes the name table node only (from the specified file or from STDIN) to STDOUT.\n");
+}
+
+int main(int argc, char **argv)
+{
+	if (argc >= 2 && strcmp(argv[1], "dissect") == 0)
+	{
+		int		debug = (argc >= 3 && strcmp(argv[2], "-d") == 0);
+
+		if (argc - debug <= 3) return dissect(argc - debug == 3 ? argv[2 + debug] : NULL, debug);
+	}
+	if (argc >= 2 && strcmp(argv[1], "build") == 0)
+	{
+		int		deflate = (argc >= 3 && strcmp(argv[2], "-z") == 0);
+
+		if (argc - deflate >= 5) return build(argv[2 + deflate], argv[3 + deflate], argv[4 + deflate], argv + 5 + deflate, argc - 5 - deflate, deflate);
+	}
+	if (argc >= 2 && argc <= 3 && strcmp(argv[1], "nametable") == 0) return nametable(argc == 3 ? argv[2] : NULL);
+
+	usage(argv[0]);
+	return 1;
+}
@@ -18,151 +18,419 @@
  *                                                                     *
  ***********************************************************************/
 
+/*
+ * decode run-length encoded data from AVM's recovery programs
+ *
+ * 0x00 <n>           - <n> zero bytes, 0x00 0x00 marks the end of the compressed content
+ * 0x01 - 0x7F        - the specified number of bytes follows and is copied unchanged
+ * 0x80 <n> <b>       - <n> times the byte <b>
+ * 0x81 <lo> <hi> <b> - (<hi> * 256 + <lo>) times the byte <b>
+ * 0x82 <n>           - <n> space characters (0x20)
+ * 0x83 - 0xFF <b>    - (opcode - 0x80) times the byte <b>
+ *
+ * The input is read from the specified file (or from STDIN) - it's mapped to memory, if possible, and read
+ * with large blocks otherwise. The decoding is done by the push-style decoder from 'rle_decoder.c', output
+ * is collected in a large buffer and runs are created with memset() and memcpy() calls.
+ *
+ * gcc -O2 -o rle_decode rle_decode.c rle_decoder.c
+ *
+ * With '-x <index_file>' no data is written, but an index file is created instead. It contains the input
+ * and output offsets of the first opcode after each <interval> bytes of output (option '-n', in KB). The
+ * option '-r <start>:<end>' writes only the output bytes from <start> up to (but not including) <end>, if
+ * an index file is specified, too, decoding starts at the nearest checkpoint in front of <start>. Both
+ * offsets may be specified in hexadecimal with a '0x' prefix, a missing <end> means the end of data.
+ *
+ * The index file is a text file:
+ *
+ * # rle_decode index
+ * SIZE <input_size>
+ * INTERVAL <interval>
+ * <input_offset> <output_offset>
+ * ...
+ */
+
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-int main(int argc, char * argv[])
+#include "rle_decoder.h"
+
+#define INPUT_BUFFER_SIZE		(4 * 1024 * 1024)
+#define OUTPUT_BUFFER_SIZE		(4 * 1024 * 1024)
+#define INDEX_INTERVAL			(1024 * 1024)
+#define INDEX_HEADER			"# rle_decode index"
+
+struct inputBuffer
+{
+	const uint8_t *	data;
+	size_t			size;
+	size_t			position;
+	size_t			offset;						/* input offset of data[0] */
+	uint8_t *		buffer;
+	int				fd;
+	int				eof;
+	int				mapped;
+};
+
+struct outputBuffer
 {
-	int c, cl;
-	int ioffset = 0;
-	int ooffset = 0;
-	
-	while ((c = getchar()) != EOF)
+	uint8_t *		data;
+	size_t			used;
+	size_t			offset;						/* total number of bytes decoded */
+	size_t			start;						/* only bytes from start to end are written */
+	size_t			end;
+	int				fd;
+};
+
+static void flushOutput(struct outputBuffer *output)
+{
+	size_t			written = 0;
+
+	while (written < output->used)
 	{
-		ioffset++;
-		cl = c;
-		if (c == 0) 
+		ssize_t		count = write(output->fd, output->data + written, output->used - written);
+
+		if (count == -1)
 		{
-			if ((c = getchar()) == EOF)
-			{
-				fprintf(stderr, "Unexpected end of file while reading number of consecutive zero bytes (0x%x -> %02x).\n\n", ioffset, cl);
-				exit(1);
-			}
-			ioffset++;
-			if (c == 0) break; // end of compressed content before end of file
-//			fprintf(stderr, "input=0x%08x output=0x%08x repeating %d zero bytes\n", ioffset, ooffset, c);
-			while (c > 0)
-			{
-				putchar(0);
-				ooffset++;
-				c--;
-			}
+			if (errno == EINTR) continue;
+			fprintf(stderr, "Error %d writing output data.\n\n", errno);
+			exit(1);
 		}
-		else if (c == 128)
+		written += count;
+	}
+	output->used = 0;
+}
+
+/* limit the data to the requested range, returns the number of bytes to skip or -1 for nothing to write */
+static ssize_t clipOutput(struct outputBuffer *output, size_t *count)
+{
+	size_t			first = output->offset;
+	size_t			last = output->offset + *count;
+	size_t			begin = (first < output->start ? output->start : first);
+	size_t			end = (last > output->end ? output->end : last);
+
+	output->offset = last;
+	if (begin >= end) return -1;
+
+	*count = end - begin;
+	return begin - first;
+}
+
+static void fillOutput(struct outputBuffer *output, uint8_t value, size_t count)
+{
+	if (clipOutput(output, &count) == -1) return;
+	while (count > 0)
+	{
+		size_t		chunk = OUTPUT_BUFFER_SIZE - output->used;
+
+		if (chunk > count) chunk = count;
+		memset(output->data + output->used, value, chunk);
+		output->used += chunk;
+		count -= chunk;
+		if (output->used == OUTPUT_BUFFER_SIZE) flushOutput(output);
+	}
+}
+
+static void copyOutput(struct outputBuffer *output, const uint8_t *data, size_t count)
+{
+	ssize_t			skip = clipOutput(output, &count);
+
+	if (skip == -1) return;
+	data += skip;
+	if (output->used + count > OUTPUT_BUFFER_SIZE) flushOutput(output);
+	memcpy(output->data + output->used, data, count);
+	output->used += count;
+}
+
+static int openInput(const char *name, struct inputBuffer *input)
+{
+	struct stat		st;
+
+	memset(input, 0, sizeof(struct inputBuffer));
+
+	if (name != NULL && (input->fd = open(name, O_RDONLY)) == -1)
+	{
+		fprintf(stderr, "Error %d opening input file '%s'.\n\n", errno, name);
+		return 1;
+	}
+
+	if (fstat(input->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		void *		data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, input->fd, 0);
+
+		if (data != MAP_FAILED)
 		{
-			int cnt;
-			if ((cnt = getchar()) == EOF)
-			{
-				fprintf(stderr, "Unexpected end of file while reading repetition length (0x%x -> %02x).\n\n", ioffset, cl);
-				exit(1);
-			}
-			ioffset++;
-			if ((c = getchar()) == EOF)
-			{
-				fprintf(stderr, "Unexpected end of file while reading byte value to repeat (0x%x -> %02x %02x).\n\n", ioffset, cl, cnt);
-				exit(1);
-			}
-			ioffset++;
-//			fprintf(stderr, "input=0x%08x output=0x%08x repeating %d bytes of %02x\n", ioffset, ooffset, cnt, c);
-			while (cnt > 0)
-			{
-				putchar(c);
-				ooffset++;
-				cnt--;
-			}
+			madvise(data, st.st_size, MADV_SEQUENTIAL);
+			input->data = data;
+			input->size = st.st_size;
+			input->mapped = 1;
+			input->eof = 1;
+			return 0;
 		}
-		else if (c == 129)
+	}
+
+	if ((input->buffer = malloc(INPUT_BUFFER_SIZE)) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the input buffer.\n\n", errno);
+		return 1;
+	}
+	input->data = input->buffer;
+
+	return 0;
+}
+
+/* the next block of input data, a mapped file is a single block */
+static size_t availableInput(struct inputBuffer *input)
+{
+	ssize_t			count;
+
+	if (input->position < input->size || input->eof) return input->size - input->position;
+
+	input->offset += input->size;
+	input->position = 0;
+	input->size = 0;
+
+	while ((count = read(input->fd, input->buffer, INPUT_BUFFER_SIZE)) == -1)
+	{
+		if (errno == EINTR) continue;
+		fprintf(stderr, "Error %d reading input data.\n\n", errno);
+		exit(1);
+	}
+	if (count == 0) input->eof = 1;
+	input->size = count;
+
+	return input->size;
+}
+
+/* the callbacks for the decoder, they stop it at the end of the requested range */
+struct decoderContext
+{
+	struct outputBuffer	output;
+	FILE *				index;
+};
+
+static int writeCallback(void *context, const uint8_t *data, size_t size)
+{
+	struct outputBuffer *	output = &((struct decoderContext *) context)->output;
+
+	copyOutput(output, data, size);
+	return (output->offset >= output->end);
+}
+
+static int fillCallback(void *context, uint8_t value, size_t count)
+{
+	struct outputBuffer *	output = &((struct decoderContext *) context)->output;
+
+	fillOutput(output, value, count);
+	return (output->offset >= output->end);
+}
+
+static int checkpointCallback(void *context, uint64_t inputOffset, uint64_t outputOffset)
+{
+	fprintf(((struct decoderContext *) context)->index, "0x%" PRIx64 " 0x%" PRIx64 "\n", inputOffset, outputOffset);
+	return 0;
+}
+
+/* find the last checkpoint in front of the specified output offset */
+static int readIndex(const char *name, size_t inputSize, size_t start, size_t *inputOffset, size_t *outputOffset)
+{
+	FILE *			index;
+	char			line[256];
+	size_t			size = SIZE_MAX;
+	size_t			interval = 0;
+	int				rc = 0;
+
+	if ((index = fopen(name, "r")) == NULL)
+	{
+		fprintf(stderr, "Error %d opening index file '%s'.\n\n", errno, name);
+		return 1;
+	}
+
+	*inputOffset = 0;
+	*outputOffset = 0;
+	if (fgets(line, sizeof(line), index) == NULL || strncmp(line, INDEX_HEADER, strlen(INDEX_HEADER)) != 0)
+	{
+		fprintf(stderr, "File '%s' is not an index file.\n\n", name);
+		fclose(index);
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), index) != NULL)
+	{
+		unsigned long long	in;
+		unsigned long long	out;
+
+		if (sscanf(line, "SIZE %llu", &in) == 1) size = in;
+		else if (sscanf(line, "INTERVAL %llu", &in) == 1) interval = in;
+		else if (sscanf(line, "%llx %llx", &in, &out) == 2)
 		{
-			int len = 2;
-			int shift = 0;
-			int cnt = 0;
-			while (len > 0)
-			{
-				int b;
-		
-				if ((b = getchar()) == EOF)
-				{	
-					fprintf(stderr, "Unexpected end of file while reading repetition length (0x%x -> %02x).\n\n", ioffset, cl);
+			if (out > start) break;
+			*inputOffset = in;
+			*outputOffset = out;
+		}
+	}
+	fclose(index);
+
+	if (size != inputSize || interval == 0 || *inputOffset >= inputSize)
+	{
+		fprintf(stderr, "Index file '%s' doesn't match the input data.\n\n", name);
+		rc = 1;
+	}
+
+	return rc;
+}
+
+static int parseRange(const char *range, size_t *start, size_t *end)
+{
+	char *			next;
+
+	*start = strtoull(range, &next, 0);
+	if (*next != ':') return 1;
+	if (*(++next) == 0)
+	{
+		*end = SIZE_MAX;
+		return 0;
+	}
+	*end = strtoull(next, &next, 0);
+
+	return (*next != 0 || *end < *start);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [ <input_file> ]\n", name);
+	fprintf(stderr, "       %s -x <index_file> [ -n <interval_in_KB> ] <input_file>\n", name);
+	fprintf(stderr, "       %s -r <start>:[<end>] [ -x <index_file> ] [ <input_file> ]\n\n", name);
+}
+
+int main(int argc, char * argv[])
+{
+	struct inputBuffer	input;
+	struct decoderContext	ctx;
+	struct rleDecoderCallbacks	callbacks;
+	struct rleDecoder	decoder;
+	const char *		indexName = NULL;
+	size_t				interval = INDEX_INTERVAL;
+	size_t				start = 0;
+	size_t				end = SIZE_MAX;
+	int					range = 0;
+	int					opt;
+
+	while ((opt = getopt(argc, argv, "x:n:r:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'x':
+				indexName = optarg;
+				break;
+
+			case 'n':
+				interval = strtoul(optarg, NULL, 10) * 1024;
+				if (interval == 0)
+				{
+					fprintf(stderr, "Invalid checkpoint interval '%s' specified.\n\n", optarg);
 					exit(1);
 				}
-				ioffset++;
-				cnt += (b << shift);
-				shift += 8;
-				len--;
-			}					
-			if ((c = getchar()) == EOF)
-			{
-				fprintf(stderr, "Unexpected end of file while reading byte value to repeat (0x%x -> %02x %04x).\n\n", ioffset, cl, cnt);
-				exit(1); 
-			}
-			ioffset++;
-//			fprintf(stderr, "input=0x%08x output=0x%08x repeating %d bytes of %02x\n", ioffset, ooffset, cnt, c);
-			while (cnt > 0)
-			{
-				putchar(c);
-				ooffset++;
-				cnt--;
-			}
+				break;
+
+			case 'r':
+				if (parseRange(optarg, &start, &end))
+				{
+					fprintf(stderr, "Invalid output range '%s' specified.\n\n", optarg);
+					exit(1);
+				}
+				range = 1;
+				break;
+
+			default:
+				usage(argv[0]);
+				exit(opt == 'h' ? 0 : 1);
 		}
-		else if (c == 130)
+	}
+
+	if (argc - optind > 1)
+	{
+		usage(argv[0]);
+		exit(1);
+	}
+
+	if (openInput(optind < argc ? argv[optind] : NULL, &input)) exit(1);
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.output.fd = 1;
+	ctx.output.start = start;
+	ctx.output.end = end;
+	if ((ctx.output.data = malloc(OUTPUT_BUFFER_SIZE)) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the output buffer.\n\n", errno);
+		exit(1);
+	}
+
+	memset(&callbacks, 0, sizeof(callbacks));
+	callbacks.write = writeCallback;
+	callbacks.fill = fillCallback;
+	callbacks.interval = interval;
+	rleDecoderInit(&decoder, &callbacks, &ctx);
+
+	if (indexName != NULL)
+	{
+		/* the index is only useful for a file, which may be accessed randomly */
+		if (!input.mapped)
 		{
-			int cnt;
-			if ((cnt = getchar()) == EOF)
-			{
-				fprintf(stderr, "Unexpected end of file while reading repetition length (0x%x -> %02x).\n\n", ioffset, cl);
-				exit(1);
-			}
-			ioffset++;
-			c = 0x20;
-//			fprintf(stderr, "input=0x%08x output=0x%08x repeating %d bytes of %02x\n", ioffset, ooffset, cnt, c);
-			while (cnt > 0)
-			{
-				putchar(c);
-				ooffset++;
-				cnt--;
-			}
+			fprintf(stderr, "An index may only be used with a regular input file.\n\n");
+			exit(1);
 		}
-		else if (c > 130)
+
+		if (range)
 		{
-			int cnt = c - 128;
-			if ((c = getchar()) == EOF)
-			{
-				fprintf(stderr, "Unexpected end of file while reading byte value to repeat (0x%x -> %02x).\n\n", ioffset, cl);
-				exit(1);
-			}
-			ioffset++;
-//			fprintf(stderr, "input=0x%08x output=0x%08x repeating %d bytes of %02x\n", ioffset, ooffset, cnt, c);
-			while (cnt > 0)
-			{
-				putchar(c);
-				ooffset++;
-				cnt--;
-			}
+			if (readIndex(indexName, input.size, start, &input.position, &ctx.output.offset)) exit(1);
+			rleDecoderSetPosition(&decoder, input.position, ctx.output.offset);
 		}
-		else // (c <= 127) is the last possibility here
+		else
 		{
-//			fprintf(stderr, "input=0x%08x output=0x%08x copying %d bytes: ", ioffset, ooffset, c);
-			int ilog = ioffset;
-			while (c > 0)
+			if ((ctx.index = fopen(indexName, "w")) == NULL)
 			{
-				int chr;
-
-				if ((chr = getchar()) == EOF)
-				{
-					fprintf(stderr, "Unexpected end of file while reading consecutive unique bytes (0x%x -> %02x -> 0x%d).\n\n", ilog, cl, ioffset - ilog);
-					exit(1);
-				}
-				ioffset++;
-//				fprintf(stderr, "%02x", chr);	
-				putchar(chr);
-				ooffset++;
-				c--;
+				fprintf(stderr, "Error %d creating index file '%s'.\n\n", errno, indexName);
+				exit(1);
 			}
-//			fprintf(stderr, "\n");
+			fprintf(ctx.index, INDEX_HEADER "\nSIZE %zu\nINTERVAL %zu\n", input.size, interval);
+			ctx.output.start = SIZE_MAX;
+			decoder.callbacks.checkpoint = checkpointCallback;
 		}
 	}
+
+	while (start < end && decoder.state != RLE_END && decoder.state != RLE_STOPPED)
+	{
+		size_t			available = availableInput(&input);
+
+		if (available == 0) break;
+		rleDecoderFeed(&decoder, input.data + input.position, available);
+		input.position += available;
+	}
+
+	if (rleDecoderFinish(&decoder))
+	{
+		char			message[256];
+
+		flushOutput(&ctx.output);
+		rleDecoderMessage(&decoder, message, sizeof(message));
+		fprintf(stderr, "%s\n\n", message);
+		exit(1);
+	}
+
+	flushOutput(&ctx.output);
+
+	if (ctx.index && (ferror(ctx.index) | fclose(ctx.index)))
+	{
+		fprintf(stderr, "Error %d writing index file '%s'.\n\n", errno, indexName);
+		exit(1);
+	}
+
 	exit(0);
 }
@@ -0,0 +1,219 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/***********************************************************************
+ *                                                                     *
+ * Copyright (C) 2016 P.Haemmerlein (http://www.yourfritz.de)          *
+ *                                                                     *
+ * This program is free software; you can redistribute it and/or       *
+ * modify it under the terms of the GNU General Public License         *
+ * as published by the Free Software Foundation; either version 2      *
+ * of the License, or (at your option) any later version.              *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program, please look for the file COPYING.          *
+ *                                                                     *
+ ***********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "rle_decoder.h"
+
+void rleDecoderInit(struct rleDecoder *decoder, const struct rleDecoderCallbacks *callbacks, void *context)
+{
+	memset(decoder, 0, offsetof(struct rleDecoder, fillBuffer));
+	decoder->state = RLE_OPCODE;
+	decoder->callbacks = *callbacks;
+	decoder->context = context;
+	decoder->opcode = 0xFF;
+}
+
+/* continue decoding at a known opcode boundary, e.g. from an index */
+void rleDecoderSetPosition(struct rleDecoder *decoder, uint64_t inputOffset, uint64_t outputOffset)
+{
+	decoder->state = RLE_OPCODE;
+	decoder->inputOffset = inputOffset;
+	decoder->outputOffset = outputOffset;
+	decoder->nextCheckpoint = outputOffset;
+}
+
+static int emitFill(struct rleDecoder *decoder, uint8_t value, size_t count)
+{
+	decoder->outputOffset += count;
+	if (count == 0) return 0;
+
+	if (decoder->callbacks.fill) return decoder->callbacks.fill(decoder->context, value, count);
+
+	memset(decoder->fillBuffer, value, (count < RLE_FILL_CHUNK ? count : RLE_FILL_CHUNK));
+	while (count > 0)
+	{
+		size_t		chunk = (count < RLE_FILL_CHUNK ? count : RLE_FILL_CHUNK);
+
+		if (decoder->callbacks.write(decoder->context, decoder->fillBuffer, chunk)) return 1;
+		count -= chunk;
+	}
+
+	return 0;
+}
+
+/* returns the number of bytes produced from this chunk of input data */
+ssize_t rleDecoderFeed(struct rleDecoder *decoder, const void *data, size_t size)
+{
+	const uint8_t *	input = (const uint8_t *) data;
+	const uint8_t *	end = input + size;
+	uint64_t		produced = decoder->outputOffset;
+	int				stop = 0;
+
+	while (input < end && !stop)
+	{
+		uint8_t		byte;
+
+		if (decoder->state == RLE_END || decoder->state == RLE_STOPPED) break;
+
+		if (decoder->state == RLE_LITERAL)
+		{
+			size_t	chunk = decoder->count - decoder->copied;
+
+			if (chunk > (size_t) (end - input)) chunk = end - input;
+			decoder->outputOffset += chunk;
+			decoder->inputOffset += chunk;
+			decoder->copied += chunk;
+			stop = decoder->callbacks.write(decoder->context, input, chunk);
+			input += chunk;
+			if (decoder->copied == decoder->count) decoder->state = RLE_OPCODE;
+			continue;
+		}
+
+		byte = *(input++);
+		decoder->inputOffset++;
+
+		switch (decoder->state)
+		{
+			case RLE_OPCODE:
+				if (decoder->callbacks.checkpoint && decoder->outputOffset >= decoder->nextCheckpoint)
+				{
+					stop = decoder->callbacks.checkpoint(decoder->context, decoder->inputOffset - 1, decoder->outputOffset);
+					if (decoder->callbacks.interval)
+						decoder->nextCheckpoint = (decoder->outputOffset / decoder->callbacks.interval + 1) * decoder->callbacks.interval;
+					else
+						decoder->nextCheckpoint = UINT64_MAX;
+				}
+
+				decoder->opcode = byte;
+				if (byte == 0)
+					decoder->state = RLE_ZERO_COUNT;
+				else if (byte == 128)
+					decoder->state = RLE_FILL8_COUNT;
+				else if (byte == 129)
+					decoder->state = RLE_FILL16_LOW;
+				else if (byte == 130)
+					decoder->state = RLE_SPACE_COUNT;
+				else if (byte > 130)
+				{
+					decoder->count = byte - 128;
+					decoder->state = RLE_FILL_VALUE;
+				}
+				else
+				{
+					decoder->count = byte;
+					decoder->copied = 0;
+					decoder->state = RLE_LITERAL;
+				}
+				break;
+
+			case RLE_ZERO_COUNT:
+				if (byte == 0)
+				{
+					/* end of compressed content */
+					decoder->state = RLE_END;
+					break;
+				}
+				stop = emitFill(decoder, 0, byte);
+				decoder->state = RLE_OPCODE;
+				break;
+
+			case RLE_FILL8_COUNT:
+				decoder->count = byte;
+				decoder->state = RLE_FILL_VALUE;
+				break;
+
+			case RLE_FILL16_LOW:
+				decoder->count = byte;
+				decoder->state = RLE_FILL16_HIGH;
+				break;
+
+			case RLE_FILL16_HIGH:
+				decoder->count += (size_t) byte << 8;
+				decoder->state = RLE_FILL_VALUE;
+				break;
+
+			case RLE_SPACE_COUNT:
+				stop = emitFill(decoder, 0x20, byte);
+				decoder->state = RLE_OPCODE;
+				break;
+
+			case RLE_FILL_VALUE:
+				stop = emitFill(decoder, byte, decoder->count);
+				decoder->state = RLE_OPCODE;
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	if (stop) decoder->state = RLE_STOPPED;
+
+	return (ssize_t) (decoder->outputOffset - produced);
+}
+
+/* the end of input data was reached, returns 1 if it was truncated within an opcode */
+int rleDecoderFinish(struct rleDecoder *decoder)
+{
+	return (decoder->state != RLE_OPCODE && decoder->state != RLE_END && decoder->state != RLE_STOPPED);
+}
+
+/* the message for truncated input, the offsets are the ones after the last byte read */
+size_t rleDecoderMessage(const struct rleDecoder *decoder, char *buffer, size_t size)
+{
+	uint64_t		offset = decoder->inputOffset;
+	int				length = 0;
+
+	switch (decoder->state)
+	{
+		case RLE_ZERO_COUNT:
+			length = snprintf(buffer, size, "Unexpected end of file while reading number of consecutive zero bytes (0x%" PRIx64 " -> %02x).", offset, decoder->opcode);
+			break;
+
+		case RLE_FILL8_COUNT:
+		case RLE_FILL16_LOW:
+		case RLE_FILL16_HIGH:
+		case RLE_SPACE_COUNT:
+			length = snprintf(buffer, size, "Unexpected end of file while reading repetition length (0x%" PRIx64 " -> %02x).", offset, decoder->opcode);
+			break;
+
+		case RLE_FILL_VALUE:
+			if (decoder->opcode == 128)
+				length = snprintf(buffer, size, "Unexpected end of file while reading byte value to repeat (0x%" PRIx64 " -> %02x %02zx).", offset, decoder->opcode, decoder->count);
+			else if (decoder->opcode == 129)
+				length = snprintf(buffer, size, "Unexpected end of file while reading byte value to repeat (0x%" PRIx64 " -> %02x %04zx).", offset, decoder->opcode, decoder->count);
+			else
+				length = snprintf(buffer, size, "Unexpected end of file while reading byte value to repeat (0x%" PRIx64 " -> %02x).", offset, decoder->opcode);
+			break;
+
+		case RLE_LITERAL:
+			length = snprintf(buffer, size, "Unexpected end of file while reading consecutive unique bytes (0x%" PRIx64 " -> %02x -> 0x%zu).", offset - decoder->copied, decoder->opcode, decoder->copied);
+			break;
+
+		default:
+			if (size > 0) *buffer = 0;
+			break;
+	}
+
+	return (length > 0 ? (size_t) length : 0);
+}
@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/***********************************************************************
+ *                                                                     *
+ * Copyright (C) 2016 P.Haemmerlein (http://www.yourfritz.de)          *
+ *                                                                     *
+ * This program is free software; you can redistribute it and/or       *
+ * modify it under the terms of the GNU General Public License         *
+ * as published by the Free Software Foundation; either version 2      *
+ * of the License, or (at your option) any later version.              *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program, please look for the file COPYING.          *
+ *                                                                     *
+ ***********************************************************************/
+
+/*
+ * push-style decoder for the run-length encoding of AVM's recovery programs (see 'rle_decode.c' for the
+ * format description)
+ *
+ * The input may be fed in chunks of any size - an opcode may be split at any byte, the decoder keeps its
+ * state between the calls. Decoded data is passed to the callbacks:
+ *
+ * - write() gets literal data (and runs, if no fill() callback was specified)
+ * - fill() gets the value and the length of a run
+ * - checkpoint() is called at the first opcode boundary after each 'interval' bytes of output
+ *
+ * A callback returning a value other than zero stops the decoder, the state is 'RLE_STOPPED' afterwards.
+ *
+ * Usage:
+ *
+ * rleDecoderInit(&decoder, &callbacks, context);
+ * while (<more data>) rleDecoderFeed(&decoder, data, size);
+ * if (rleDecoderFinish(&decoder)) <truncated input, see rleDecoderMessage()>
+ */
+
+#ifndef RLE_DECODER_H
+#define RLE_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define RLE_FILL_CHUNK			4096
+
+enum rleDecoderState
+{
+	RLE_OPCODE,
+	RLE_ZERO_COUNT,
+	RLE_FILL8_COUNT,
+	RLE_FILL16_LOW,
+	RLE_FILL16_HIGH,
+	RLE_SPACE_COUNT,
+	RLE_FILL_VALUE,
+	RLE_LITERAL,
+	RLE_END,
+	RLE_STOPPED,
+};
+
+struct rleDecoderCallbacks
+{
+	int				(*write)(void *context, const uint8_t *data, size_t size);
+	int				(*fill)(void *context, uint8_t value, size_t count);
+	int				(*checkpoint)(void *context, uint64_t inputOffset, uint64_t outputOffset);
+	uint64_t		interval;
+};
+
+struct rleDecoder
+{
+	enum rleDecoderState	state;
+	uint8_t					opcode;
+	size_t					count;					/* run length or literal size */
+	size_t					copied;					/* literal bytes copied so far */
+	uint64_t				inputOffset;			/* number of bytes consumed */
+	uint64_t				outputOffset;			/* number of bytes produced */
+	uint64_t				nextCheckpoint;
+	struct rleDecoderCallbacks	callbacks;
+	void *					context;
+	uint8_t					fillBuffer[RLE_FILL_CHUNK];
+};
+
+void rleDecoderInit(struct rleDecoder *decoder, const struct rleDecoderCallbacks *callbacks, void *context);
+void rleDecoderSetPosition(struct rleDecoder *decoder, uint64_t inputOffset, uint64_t outputOffset);
+ssize_t rleDecoderFeed(struct rleDecoder *decoder, const void *data, size_t size);
+int rleDecoderFinish(struct rleDecoder *decoder);
+size_t rleDecoderMessage(const struct rleDecoder *decoder, char *buffer, size_t size);
+
+#endif
@@ -0,0 +1,673 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/***********************************************************************
+ *                                                                     *
+ * Copyright (C) 2016 P.Haemmerlein (http://www.yourfritz.de)          *
+ *                                                                     *
+ * This program is free software; you can redistribute it and/or       *
+ * modify it under the terms of the GNU General Public License         *
+ * as published by the Free Software Foundation; either version 2      *
+ * of the License, or (at your option) any later version.              *
+ *                                                                     *
+ * This program is distributed in the hope that it will be useful,     *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the       *
+ * GNU General Public License for more details.                        *
+ *                                                                     *
+ * You should have received a copy of the GNU General Public License   *
+ * along with this program, please look for the file COPYING.          *
+ *                                                                     *
+ ***********************************************************************/
+
+/*
+ * encode data with the run-length encoding used by AVM's recovery programs, see 'rle_decode.c' for the
+ * format description
+ *
+ * The input is processed in blocks of 1 MB and the shortest encoding for each block is found with dynamic
+ * programming over all positions:
+ *
+ * - a literal of up to 127 bytes costs one byte more than its content, the cheapest start for a literal
+ *   ending at a position is taken from a sliding window minimum
+ * - a run starting at a position is tried with the longest length possible for each opcode (2 bytes for
+ *   zeros, spaces and 3 to 127 bytes of any value, 3 bytes for up to 255 and 4 bytes for up to 65535
+ *   bytes of any value)
+ *
+ * Block boundaries within runs are moved to a multiple of 65535 bytes from the start of the run (or to its
+ * end), so only the headers of literals crossing a boundary may cost an additional byte. Memory usage is
+ * independent of the input size.
+ *
+ * With '-b <size>' a benchmark is run with a synthetic corpus of <size> MB for each pattern. Each encoded
+ * pattern is decoded again (with the decoder from 'rle_decoder.c') and compared with the original data.
+ * Additionally some runs longer than 64 KB are encoded and the size is compared with the result of an
+ * exhaustive search, which tries every length for each opcode.
+ *
+ * gcc -O2 -o rle_encode rle_encode.c rle_decoder.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "rle_decoder.h"
+
+#define BLOCK_SIZE				(1024 * 1024)
+#define MAX_LITERAL				127
+#define MAX_SHORT_FILL			127
+#define MAX_FILL8				255
+#define MAX_FILL16				65535
+#define BUFFER_SIZE				(BLOCK_SIZE + 2 * MAX_FILL16)
+#define OUTPUT_BUFFER_SIZE		(1024 * 1024)
+
+enum opcodeKind
+{
+	OPCODE_NONE,
+	OPCODE_LITERAL,
+	OPCODE_ZEROS,
+	OPCODE_SPACES,
+	OPCODE_SHORT_FILL,
+	OPCODE_FILL8,
+	OPCODE_FILL16,
+};
+
+/* output goes to a file descriptor or to a growing memory buffer */
+struct outputBuffer
+{
+	uint8_t *		data;
+	size_t			used;
+	size_t			allocated;
+	size_t			total;
+	int				fd;
+};
+
+struct encoderState
+{
+	uint8_t *		data;
+	size_t			size;
+	uint32_t *		cost;
+	uint16_t *		length;
+	uint16_t *		run;
+	uint8_t *		kind;
+	uint32_t *		window;
+};
+
+static void flushOutput(struct outputBuffer *output)
+{
+	size_t			written = 0;
+
+	if (output->fd == -1) return;
+
+	while (written < output->used)
+	{
+		ssize_t		count = write(output->fd, output->data + written, output->used - written);
+
+		if (count == -1)
+		{
+			if (errno == EINTR) continue;
+			fprintf(stderr, "Error %d writing output data.\n\n", errno);
+			exit(1);
+		}
+		written += count;
+	}
+	output->used = 0;
+}
+
+static void writeOutput(struct outputBuffer *output, const uint8_t *data, size_t size)
+{
+	if (output->used + size > output->allocated)
+	{
+		if (output->fd != -1)
+			flushOutput(output);
+		else
+		{
+			uint8_t *	larger;
+
+			output->allocated = (output->allocated + size) * 2;
+			if ((larger = realloc(output->data, output->allocated)) == NULL)
+			{
+				fprintf(stderr, "Error %d allocating memory for the output buffer.\n\n", errno);
+				exit(1);
+			}
+			output->data = larger;
+		}
+	}
+	memcpy(output->data + output->used, data, size);
+	output->used += size;
+	output->total += size;
+}
+
+static void emitOpcode(struct outputBuffer *output, enum opcodeKind kind, size_t length, const uint8_t *data)
+{
+	uint8_t			opcode[4];
+
+	switch (kind)
+	{
+		case OPCODE_LITERAL:
+			opcode[0] = (uint8_t) length;
+			writeOutput(output, opcode, 1);
+			writeOutput(output, data, length);
+			break;
+
+		case OPCODE_ZEROS:
+			opcode[0] = 0;
+			opcode[1] = (uint8_t) length;
+			writeOutput(output, opcode, 2);
+			break;
+
+		case OPCODE_SPACES:
+			opcode[0] = 130;
+			opcode[1] = (uint8_t) length;
+			writeOutput(output, opcode, 2);
+			break;
+
+		case OPCODE_SHORT_FILL:
+			opcode[0] = (uint8_t) (128 + length);
+			opcode[1] = *data;
+			writeOutput(output, opcode, 2);
+			break;
+
+		case OPCODE_FILL8:
+			opcode[0] = 128;
+			opcode[1] = (uint8_t) length;
+			opcode[2] = *data;
+			writeOutput(output, opcode, 3);
+			break;
+
+		case OPCODE_FILL16:
+			opcode[0] = 129;
+			opcode[1] = (uint8_t) (length & 0xFF);
+			opcode[2] = (uint8_t) (length >> 8);
+			opcode[3] = *data;
+			writeOutput(output, opcode, 4);
+			break;
+
+		default:
+			break;
+	}
+}
+
+static int initializeEncoder(struct encoderState *encoder)
+{
+	memset(encoder, 0, sizeof(struct encoderState));
+
+	encoder->data = malloc(BUFFER_SIZE);
+	encoder->cost = malloc((BUFFER_SIZE + 1) * sizeof(uint32_t));
+	encoder->length = malloc((BUFFER_SIZE + 1) * sizeof(uint16_t));
+	encoder->run = malloc(BUFFER_SIZE * sizeof(uint16_t));
+	encoder->kind = malloc(BUFFER_SIZE + 1);
+	encoder->window = malloc((BUFFER_SIZE + 1) * sizeof(uint32_t));
+
+	if (!encoder->data || !encoder->cost || !encoder->length || !encoder->run || !encoder->kind || !encoder->window)
+	{
+		fprintf(stderr, "Error %d allocating memory for the encoder.\n\n", errno);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void releaseEncoder(struct encoderState *encoder)
+{
+	free(encoder->data);
+	free(encoder->cost);
+	free(encoder->length);
+	free(encoder->run);
+	free(encoder->kind);
+	free(encoder->window);
+}
+
+static inline void relax(struct encoderState *encoder, size_t from, size_t length, uint32_t cost, enum opcodeKind kind)
+{
+	uint32_t		total = encoder->cost[from] + cost;
+
+	if (total < encoder->cost[from + length])
+	{
+		encoder->cost[from + length] = total;
+		encoder->length[from + length] = (uint16_t) length;
+		encoder->kind[from + length] = kind;
+	}
+}
+
+/* find the shortest encoding for data[0 .. size - 1] and write it */
+static void encodeBlock(struct encoderState *encoder, size_t size, struct outputBuffer *output)
+{
+	const uint8_t *	data = encoder->data;
+	uint32_t *		window = encoder->window;
+	size_t			head = 0;
+	size_t			tail = 0;
+	size_t			position;
+	size_t			count;
+
+	if (size == 0) return;
+
+	/* length of the run starting at each position, limited to the longest run of a single opcode */
+	encoder->run[size - 1] = 1;
+	for (position = size - 1; position > 0; position--)
+	{
+		uint16_t	next = encoder->run[position];
+
+		encoder->run[position - 1] = (data[position - 1] != data[position] ? 1 : (next < MAX_FILL16 ? next + 1 : MAX_FILL16));
+	}
+
+	encoder->cost[0] = 0;
+	encoder->kind[0] = OPCODE_NONE;
+	for (position = 1; position <= size; position++) encoder->cost[position] = UINT32_MAX;
+
+	for (position = 0; position <= size; position++)
+	{
+		size_t		runLength;
+		uint8_t		value;
+
+		/* the cheapest literal ending here, window contains start positions with increasing cost - position */
+		if (position > 0)
+		{
+			while (head < tail && window[head] + MAX_LITERAL < position) head++;
+			if (head < tail)
+			{
+				size_t		start = window[head];
+				uint32_t	total = encoder->cost[start] + (uint32_t) (position - start) + 1;
+
+				if (total < encoder->cost[position])
+				{
+					encoder->cost[position] = total;
+					encoder->length[position] = (uint16_t) (position - start);
+					encoder->kind[position] = OPCODE_LITERAL;
+				}
+			}
+		}
+
+		while (head < tail && (int64_t) encoder->cost[window[tail - 1]] - (int64_t) window[tail - 1] >= (int64_t) encoder->cost[position] - (int64_t) position) tail--;
+		window[tail++] = (uint32_t) position;
+
+		if (position == size) break;
+
+		runLength = encoder->run[position];
+		value = data[position];
+
+		if (value == 0) relax(encoder, position, (runLength < MAX_FILL8 ? runLength : MAX_FILL8), 2, OPCODE_ZEROS);
+		else if (value == 0x20) relax(encoder, position, (runLength < MAX_FILL8 ? runLength : MAX_FILL8), 2, OPCODE_SPACES);
+		if (runLength >= 3) relax(encoder, position, (runLength < MAX_SHORT_FILL ? runLength : MAX_SHORT_FILL), 2, OPCODE_SHORT_FILL);
+		if (runLength > MAX_SHORT_FILL && value != 0 && value != 0x20) relax(encoder, position, (runLength < MAX_FILL8 ? runLength : MAX_FILL8), 3, OPCODE_FILL8);
+		if (runLength > MAX_FILL8) relax(encoder, position, runLength, 4, OPCODE_FILL16);
+	}
+
+	/* collect the chosen opcodes backwards, the window array isn't needed anymore */
+	for (count = 0, position = size; position > 0; position -= encoder->length[position]) window[count++] = (uint32_t) position;
+
+	while (count > 0)
+	{
+		size_t		end = window[--count];
+		size_t		length = encoder->length[end];
+
+		emitOpcode(output, encoder->kind[end], length, data + end - length);
+	}
+}
+
+/* the end of a block is moved out of a run, to a multiple of the maximum run length from its start */
+static size_t blockEnd(const uint8_t *data, size_t size)
+{
+	size_t			end = BLOCK_SIZE;
+	size_t			start;
+	size_t			runEnd;
+
+	if (size <= BLOCK_SIZE) return size;
+	if (data[end - 1] != data[end]) return end;
+
+	for (start = end - 1; start > 0 && data[start - 1] == data[start]; start--);
+	for (runEnd = end; runEnd < size && data[runEnd] == data[end]; runEnd++);
+
+	end = start + ((end - start + MAX_FILL16 - 1) / MAX_FILL16) * MAX_FILL16;
+	return (end < runEnd ? end : runEnd);
+}
+
+/* encode everything from a file descriptor or from memory (fd == -1) */
+static void encodeData(struct encoderState *encoder, int fd, const uint8_t *memory, size_t memorySize, struct outputBuffer *output)
+{
+	int				eof = 0;
+
+	encoder->size = 0;
+
+	while (1)
+	{
+		size_t		end;
+
+		while (!eof && encoder->size < BUFFER_SIZE)
+		{
+			if (fd == -1)
+			{
+				size_t	chunk = (memorySize < BUFFER_SIZE - encoder->size ? memorySize : BUFFER_SIZE - encoder->size);
+
+				memcpy(encoder->data + encoder->size, memory, chunk);
+				memory += chunk;
+				memorySize -= chunk;
+				encoder->size += chunk;
+				if (memorySize == 0) eof = 1;
+			}
+			else
+			{
+				ssize_t	count = read(fd, encoder->data + encoder->size, BUFFER_SIZE - encoder->size);
+
+				if (count == -1)
+				{
+					if (errno == EINTR) continue;
+					fprintf(stderr, "Error %d reading input data.\n\n", errno);
+					exit(1);
+				}
+				if (count == 0) eof = 1;
+				encoder->size += count;
+			}
+		}
+
+		if (encoder->size == 0) break;
+
+		end = (eof ? encoder->size : blockEnd(encoder->data, encoder->size));
+		encodeBlock(encoder, end, output);
+		memmove(encoder->data, encoder->data + end, encoder->size - end);
+		encoder->size -= end;
+	}
+}
+
+/* the encoded data is decoded again with the decoder from 'rle_decoder.c' and compared with the original */
+struct verifyContext
+{
+	const uint8_t *	original;
+	size_t			size;
+	size_t			offset;
+};
+
+static int verifyWrite(void *context, const uint8_t *data, size_t size)
+{
+	struct verifyContext *	verify = (struct verifyContext *) context;
+
+	if (verify->offset + size > verify->size || memcmp(verify->original + verify->offset, data, size)) return 1;
+	verify->offset += size;
+	return 0;
+}
+
+static int verifyFill(void *context, uint8_t value, size_t count)
+{
+	struct verifyContext *	verify = (struct verifyContext *) context;
+	size_t					i;
+
+	if (verify->offset + count > verify->size) return 1;
+	for (i = 0; i < count; i++) if (verify->original[verify->offset + i] != value) return 1;
+	verify->offset += count;
+	return 0;
+}
+
+static int verifyEncoding(const uint8_t *encoded, size_t encodedSize, const uint8_t *original, size_t originalSize)
+{
+	struct rleDecoderCallbacks	callbacks = { verifyWrite, verifyFill, NULL, 0 };
+	struct verifyContext	verify = { original, originalSize, 0 };
+	struct rleDecoder *		decoder;
+	int						failed;
+
+	/* the decoder contains its fill buffer, it's too large for the stack of some devices */
+	if ((decoder = malloc(sizeof(struct rleDecoder))) == NULL) return 1;
+	rleDecoderInit(decoder, &callbacks, &verify);
+	rleDecoderFeed(decoder, encoded, encodedSize);
+	failed = (decoder->state == RLE_STOPPED || rleDecoderFinish(decoder) || verify.offset != originalSize);
+	free(decoder);
+
+	return failed;
+}
+
+static void fillPattern(uint8_t *data, size_t size, int pattern)
+{
+	uint32_t		random = 0x12345678 + pattern;
+	size_t			i = 0;
+
+#define NEXT_RANDOM		(random = random * 1103515245 + 12345, (random >> 16) & 0x7FFF)
+
+	while (i < size)
+	{
+		size_t		length = NEXT_RANDOM;
+		int			value = NEXT_RANDOM & 0xFF;
+
+		switch (pattern)
+		{
+			case 0:		/* erased flash */
+				memset(data, 0xFF, size);
+				return;
+
+			case 1:		/* random data */
+				data[i++] = (uint8_t) value;
+				continue;
+
+			case 2:		/* text with indentation */
+				if (NEXT_RANDOM % 4 == 0) value = 0x20, length %= 16;
+				else value = 'a' + value % 26, length = 1;
+				break;
+
+			case 3:		/* mixed binary with zero padding */
+				if (NEXT_RANDOM % 3 == 0) value = 0, length %= 4096;
+				else if (NEXT_RANDOM % 2 == 0) length %= 8;
+				else length = 1;
+				break;
+
+			default:	/* short runs of all sizes */
+				length %= 300;
+				break;
+		}
+
+		if (length > size - i) length = size - i;
+		memset(data + i, value, length);
+		i += length;
+	}
+
+#undef NEXT_RANDOM
+}
+
+/* the size of the shortest encoding, found by trying every length for each opcode at each position */
+static size_t minimalSize(const uint8_t *data, size_t size)
+{
+	uint32_t *		cost;
+	uint32_t *		run;
+	size_t			position;
+	size_t			length;
+	size_t			result;
+
+	cost = malloc((size + 1) * sizeof(uint32_t));
+	run = malloc((size + 1) * sizeof(uint32_t));
+	if (!cost || !run)
+	{
+		free(cost);
+		free(run);
+		return SIZE_MAX;
+	}
+
+	run[size] = 0;
+	for (position = size; position > 0; position--) run[position - 1] = (position < size && data[position - 1] == data[position] ? run[position] + 1 : 1);
+
+	cost[0] = 0;
+	for (position = 1; position <= size; position++) cost[position] = UINT32_MAX;
+
+	for (position = 0; position < size; position++)
+	{
+		uint32_t	base = cost[position];
+		uint32_t *	next = cost + position;
+		size_t		limit;
+
+		limit = (size - position < MAX_LITERAL ? size - position : MAX_LITERAL);
+		for (length = 1; length <= limit; length++) next[length] = (base + length + 1 < next[length] ? base + (uint32_t) length + 1 : next[length]);
+
+		if (data[position] == 0 || data[position] == 0x20)
+		{
+			limit = (run[position] < MAX_FILL8 ? run[position] : MAX_FILL8);
+			for (length = 1; length <= limit; length++) next[length] = (base + 2 < next[length] ? base + 2 : next[length]);
+		}
+
+		limit = (run[position] < MAX_SHORT_FILL ? run[position] : MAX_SHORT_FILL);
+		for (length = 3; length <= limit; length++) next[length] = (base + 2 < next[length] ? base + 2 : next[length]);
+
+		limit = (run[position] < MAX_FILL8 ? run[position] : MAX_FILL8);
+		for (length = 1; length <= limit; length++) next[length] = (base + 3 < next[length] ? base + 3 : next[length]);
+
+		limit = (run[position] < MAX_FILL16 ? run[position] : MAX_FILL16);
+		for (length = 1; length <= limit; length++) next[length] = (base + 4 < next[length] ? base + 4 : next[length]);
+	}
+
+	result = cost[size];
+	free(cost);
+	free(run);
+	return result;
+}
+
+/* runs longer than the longest run of a single opcode, their encoding has to be as short as possible */
+static int checkLongRuns(struct encoderState *encoder)
+{
+	static const struct
+	{
+		size_t		length;
+		uint8_t		value;
+	}					runs[] = { { 65537, 0xAA }, { 131072, 0xAA }, { 65536 + 130, 0x00 } };
+	struct outputBuffer	output;
+	uint8_t *			data;
+	size_t				size;
+	size_t				i;
+	int					rc = 0;
+
+	printf("\n%-20s %12s %12s %8s %10s %8s\n", "long run", "input", "output", "minimal", "", "verify");
+	for (i = 0; i < sizeof(runs) / sizeof(runs[0]); i++)
+	{
+		char		label[32];
+		size_t		minimal;
+		int			failed;
+
+		size = runs[i].length;
+		if ((data = malloc(size)) == NULL)
+		{
+			fprintf(stderr, "Error %d allocating memory for the benchmark data.\n\n", errno);
+			return 1;
+		}
+		memset(data, runs[i].value, size);
+
+		memset(&output, 0, sizeof(output));
+		output.fd = -1;
+		encodeData(encoder, -1, data, size, &output);
+		minimal = minimalSize(data, size);
+
+		failed = (verifyEncoding(output.data, output.used, data, size) || output.used != minimal);
+		rc |= failed;
+		snprintf(label, sizeof(label), "%zu x 0x%02X", size, runs[i].value);
+		printf("%-20s %12zu %12zu %8zu %10s %8s\n", label, size, output.used, minimal, "", (failed ? "FAILED" : "ok"));
+		free(output.data);
+		free(data);
+	}
+
+	return rc;
+}
+
+static int benchmark(struct encoderState *encoder, size_t size)
+{
+	static const char *	patterns[] = { "erased flash (0xFF)", "random data", "text", "mixed binary", "short runs" };
+	struct outputBuffer	output;
+	uint8_t *			data;
+	size_t				i;
+	int					rc = 0;
+
+	if ((data = malloc(size)) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the benchmark data.\n\n", errno);
+		return 1;
+	}
+
+	printf("%-20s %12s %12s %8s %10s %8s\n", "pattern", "input", "output", "ratio", "MB/s", "verify");
+	for (i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++)
+	{
+		struct timespec	start;
+		struct timespec	stop;
+		double			seconds;
+		int				failed;
+
+		fillPattern(data, size, (int) i);
+		memset(&output, 0, sizeof(output));
+		output.fd = -1;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		encodeData(encoder, -1, data, size, &output);
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+		seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+		failed = verifyEncoding(output.data, output.used, data, size);
+		rc |= failed;
+		printf("%-20s %12zu %12zu %7.2f%% %10.1f %8s\n", patterns[i], size, output.used, 100.0 * output.used / size,
+			size / seconds / (1024 * 1024), (failed ? "FAILED" : "ok"));
+		free(output.data);
+	}
+
+	free(data);
+	return rc | checkLongRuns(encoder);
+}
+
+int main(int argc, char * argv[])
+{
+	struct encoderState	encoder;
+	struct outputBuffer	output;
+	size_t				benchmarkSize = 0;
+	int					endMarker = 0;
+	int					fd = 0;
+	int					opt;
+	int					rc = 0;
+
+	while ((opt = getopt(argc, argv, "eb:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'e':
+				endMarker = 1;
+				break;
+
+			case 'b':
+				benchmarkSize = strtoul(optarg, NULL, 10) * 1024 * 1024;
+				if (benchmarkSize == 0)
+				{
+					fprintf(stderr, "Invalid benchmark size '%s' specified.\n\n", optarg);
+					exit(1);
+				}
+				break;
+
+			default:
+				fprintf(stderr, "Usage: %s [ -e ] [ <input_file> ]\n", argv[0]);
+				fprintf(stderr, "       %s -b <size_in_MB>\n\n", argv[0]);
+				fprintf(stderr, "Encodes the data from the specified file (or from STDIN) and writes the result to STDOUT,\n");
+				fprintf(stderr, "'-e' appends an end marker. '-b' runs a benchmark with synthetic data.\n\n");
+				exit(opt == 'h' ? 0 : 1);
+		}
+	}
+
+	if (initializeEncoder(&encoder)) exit(1);
+
+	if (benchmarkSize)
+	{
+		rc = benchmark(&encoder, benchmarkSize);
+		releaseEncoder(&encoder);
+		exit(rc);
+	}
+
+	if (optind < argc && (fd = open(argv[optind], O_RDONLY)) == -1)
+	{
+		fprintf(stderr, "Error %d opening input file '%s'.\n\n", errno, argv[optind]);
+		exit(1);
+	}
+
+	memset(&output, 0, sizeof(output));
+	output.fd = 1;
+	output.allocated = OUTPUT_BUFFER_SIZE;
+	if ((output.data = malloc(OUTPUT_BUFFER_SIZE)) == NULL)
+	{
+		fprintf(stderr, "Error %d allocating memory for the output buffer.\n\n", errno);
+		exit(1);
+	}
+
+	encodeData(&encoder, fd, NULL, 0, &output);
+	if (endMarker) writeOutput(&output, (const uint8_t *) "\0\0", 2);
+	flushOutput(&output);
+
+	free(output.data);
+	releaseEncoder(&encoder);
+	exit(rc);
+}